@@ -0,0 +1,350 @@
+#include "./Batch.h"
+#include "./MsgPackWriter.h"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+bool readManifest(std::istream& in, std::vector<BatchEntry>& entries,
+                  std::string& error) {
+  std::string line;
+  unsigned lineNumber = 0;
+  while (std::getline(in, line)) {
+    ++lineNumber;
+    const llvm::StringRef trimmed = llvm::StringRef(line).trim();
+    if (trimmed.empty()) continue;
+
+    BatchEntry entry;
+    if (!trimmed.startswith("{")) {
+      entry.path = trimmed.str();
+      entries.push_back(entry);
+      continue;
+    }
+
+    rapidjson::Document document;
+    document.Parse(line.c_str());
+    if (document.HasParseError() || !document.IsObject() ||
+        !document.HasMember("file") || !document["file"].IsString()) {
+      error = "Line " + std::to_string(lineNumber) + " of the manifest must "
+              "be a path or an object with a \"file\"";
+      return false;
+    }
+    entry.path = document["file"].GetString();
+    if (document.HasMember("flags") && document["flags"].IsArray()) {
+      const rapidjson::Value& flags = document["flags"];
+      for (rapidjson::SizeType i = 0; i < flags.Size(); ++i) {
+        if (flags[i].IsString()) entry.flags.push_back(flags[i].GetString());
+      }
+    }
+    entries.push_back(entry);
+  }
+  return true;
+}
+
+template <typename Writer>
+static void writeErrorRecord(Writer& writer, const std::string& path,
+                             const std::string& message) {
+  writer.StartObject();
+  writer.Key("file");
+  writer.String(path.c_str(), path.size());
+  writer.Key("error");
+  writer.String(message.c_str(), message.size());
+  writer.EndObject();
+}
+
+// Record of a file that could not be translated, in the output format
+static std::string dumpErrorRecord(const std::string& path,
+                                   const std::string& message,
+                                   const TranslationOptions& options) {
+  rapidjson::StringBuffer buffer;
+  if (options.format == OutputFormat::MsgPack) {
+    MsgPackWriter<rapidjson::StringBuffer> writer(buffer);
+    writeErrorRecord(writer, path, message);
+    return std::string(buffer.GetString(), buffer.GetSize());
+  }
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writeErrorRecord(writer, path, message);
+  return std::string(buffer.GetString(), buffer.GetSize()) + "\n";
+}
+
+// Reads or writes all the bytes. Returns false at the end of the pipe, or if
+// the other side is gone.
+static bool readAll(int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    const ssize_t count = read(fd, bytes, size);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) return false;
+    bytes += count;
+    size -= count;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t count = write(fd, bytes, size);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) return false;
+    bytes += count;
+    size -= count;
+  }
+  return true;
+}
+
+// Sent by a worker before the output of each file
+struct BatchReply {
+  int32_t status;
+  uint64_t size;
+};
+
+// A forked process, translating the entries whose index it is sent
+struct BatchWorker {
+  BatchWorker() : pid(-1), requestFd(-1), replyFd(-1), busy(false), entry(0) {}
+
+  pid_t pid;     // -1 when it is not running
+  int requestFd; // Where the index of the next entry is written
+  int replyFd;   // Where the BatchReply and the output are read
+  bool busy;
+  size_t entry;  // Entry being translated, if busy
+  Clock::time_point deadline;
+};
+
+// Body of a worker process, until its requests are closed
+static void runWorker(const clang::tooling::CompilationDatabase& compilations,
+                      const std::vector<BatchEntry>& entries,
+                      const TranslationOptions& options, size_t reserve,
+                      int requestFd, int replyFd) {
+  OutputArena arena(reserve);
+  std::string output;
+  uint64_t index;
+  while (readAll(requestFd, &index, sizeof(index))) {
+    const BatchEntry& entry = entries[index];
+    TranslationOptions entryOptions = options;
+    entryOptions.flags.insert(entryOptions.flags.end(),
+                              entry.flags.begin(), entry.flags.end());
+
+    BatchReply reply;
+    reply.status = translateFileToString(compilations, entry.path,
+                                         entryOptions, arena, output);
+    reply.size = output.size();
+    if (!writeAll(replyFd, &reply, sizeof(reply)) ||
+        !writeAll(replyFd, output.data(), output.size())) {
+      return;
+    }
+  }
+}
+
+static bool startWorker(BatchWorker& worker, std::vector<BatchWorker>& pool,
+                        const clang::tooling::CompilationDatabase& compilations,
+                        const std::vector<BatchEntry>& entries,
+                        const TranslationOptions& options, size_t reserve,
+                        std::FILE* out) {
+  int requestPipe[2];
+  int replyPipe[2];
+  if (pipe(requestPipe) != 0) return false;
+  if (pipe(replyPipe) != 0) {
+    close(requestPipe[0]);
+    close(requestPipe[1]);
+    return false;
+  }
+
+  // Nothing buffered may be written twice
+  std::fflush(out);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(requestPipe[0]);
+    close(requestPipe[1]);
+    close(replyPipe[0]);
+    close(replyPipe[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    // Only its own pipes stay open, so the others see the end of theirs
+    for (const BatchWorker& other : pool) {
+      if (other.pid < 0) continue;
+      close(other.requestFd);
+      close(other.replyFd);
+    }
+    close(requestPipe[1]);
+    close(replyPipe[0]);
+    runWorker(compilations, entries, options, reserve, requestPipe[0],
+              replyPipe[1]);
+    _exit(0);
+  }
+
+  close(requestPipe[0]);
+  close(replyPipe[1]);
+  worker.pid = pid;
+  worker.requestFd = requestPipe[1];
+  worker.replyFd = replyPipe[0];
+  worker.busy = false;
+  return true;
+}
+
+// Closes the pipes of the worker, and waits for it after killing it if asked.
+// Returns how it ended.
+static std::string stopWorker(BatchWorker& worker, bool kill) {
+  close(worker.requestFd);
+  close(worker.replyFd);
+  if (kill) ::kill(worker.pid, SIGKILL);
+
+  int status = 0;
+  while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  worker.pid = -1;
+  worker.requestFd = -1;
+  worker.replyFd = -1;
+  worker.busy = false;
+
+  if (WIFSIGNALED(status)) {
+    return "Worker crashed with signal " + std::to_string(WTERMSIG(status)) +
+           " (" + strsignal(WTERMSIG(status)) + ")";
+  }
+  return "Worker exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+int runBatch(const clang::tooling::CompilationDatabase& compilations,
+             const std::vector<BatchEntry>& entries,
+             const TranslationOptions& batchOptions, unsigned workers,
+             unsigned timeoutSeconds, std::FILE* out) {
+  // Every file is a record, statistics are not collected by the workers
+  TranslationOptions options = batchOptions;
+  options.ndjson = true;
+  options.visitor.streamStatements = false;
+  options.stats = nullptr;
+
+  // Workers that die are found when reading, not by a signal
+  signal(SIGPIPE, SIG_IGN);
+
+  const size_t numEntries = entries.size();
+  if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+  workers = std::min<size_t>(workers, std::max<size_t>(numEntries, 1));
+  std::vector<BatchWorker> pool(workers);
+
+  std::vector<std::string> results(numEntries);
+  std::vector<bool> finished(numEntries, false);
+  size_t nextEntry = 0;
+  size_t nextOutput = 0;
+  size_t largestOutput = 0; // Reserved by the workers started later
+  int returnValue = 0;
+
+  // Keeps the result, and writes the ones that are next in manifest order
+  auto finish = [&](size_t entry, int status, std::string output) {
+    returnValue = std::max(returnValue, status);
+    results[entry] = std::move(output);
+    finished[entry] = true;
+    for (; nextOutput < numEntries && finished[nextOutput]; ++nextOutput) {
+      std::fwrite(results[nextOutput].data(), 1, results[nextOutput].size(),
+                  out);
+      std::string().swap(results[nextOutput]);
+    }
+    std::fflush(out);
+  };
+
+  while (nextOutput < numEntries) {
+    // Hand the next entries to the idle workers, restarting the dead ones
+    for (BatchWorker& worker : pool) {
+      if (worker.busy || nextEntry >= numEntries) continue;
+      if (worker.pid < 0 && !startWorker(worker, pool, compilations, entries,
+                                         options, largestOutput, out)) {
+        const int error = errno;
+        // None of the started ones is left behind
+        for (BatchWorker& started : pool) {
+          if (started.pid >= 0) stopWorker(started, true);
+        }
+        llvm::errs() << "Could not start a worker: " << std::strerror(error)
+                     << "\n";
+        return 1;
+      }
+      const uint64_t index = nextEntry;
+      worker.busy = true;
+      worker.entry = nextEntry++;
+      worker.deadline = Clock::now() + std::chrono::seconds(timeoutSeconds);
+      // If it is gone, its reply pipe is closed too
+      writeAll(worker.requestFd, &index, sizeof(index));
+    }
+
+    // Wait for a reply, or until the first deadline
+    std::vector<pollfd> fds;
+    std::vector<BatchWorker*> polled;
+    int waitMilliseconds = -1;
+    const Clock::time_point now = Clock::now();
+    for (BatchWorker& worker : pool) {
+      if (!worker.busy) continue;
+      pollfd fd;
+      fd.fd = worker.replyFd;
+      fd.events = POLLIN;
+      fd.revents = 0;
+      fds.push_back(fd);
+      polled.push_back(&worker);
+      if (timeoutSeconds == 0) continue;
+      const long long remaining =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              worker.deadline - now).count();
+      const int wait = static_cast<int>(std::max(0LL, remaining));
+      if (waitMilliseconds < 0 || wait < waitMilliseconds) {
+        waitMilliseconds = wait;
+      }
+    }
+    if (poll(fds.data(), fds.size(), waitMilliseconds) < 0 && errno != EINTR) {
+      llvm::errs() << "Could not wait for the workers: "
+                   << std::strerror(errno) << "\n";
+      return 1;
+    }
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+      BatchWorker& worker = *polled[i];
+      const std::string& path = entries[worker.entry].path;
+      if (fds[i].revents != 0) {
+        BatchReply reply;
+        std::string output;
+        bool received = readAll(worker.replyFd, &reply, sizeof(reply));
+        if (received && reply.size > 0) {
+          output.resize(reply.size);
+          received = readAll(worker.replyFd, &output[0], reply.size);
+        }
+        if (received) {
+          worker.busy = false;
+          largestOutput = std::max<size_t>(largestOutput, reply.size);
+          finish(worker.entry, reply.status, std::move(output));
+        }
+        else {
+          const size_t entry = worker.entry;
+          finish(entry, 1, dumpErrorRecord(path, stopWorker(worker, false),
+                                           options));
+        }
+      }
+      else if (timeoutSeconds > 0 && Clock::now() >= worker.deadline) {
+        const size_t entry = worker.entry;
+        stopWorker(worker, true);
+        finish(entry, 1, dumpErrorRecord(
+            path, "Timed out after " + std::to_string(timeoutSeconds) +
+                  " seconds", options));
+      }
+    }
+  }
+
+  // Closing their requests ends the workers
+  for (BatchWorker& worker : pool) {
+    if (worker.pid >= 0) stopWorker(worker, false);
+  }
+  return returnValue;
+}
@@ -0,0 +1,34 @@
+#ifndef CPPTRANSLATE_BATCH_H
+#define CPPTRANSLATE_BATCH_H
+
+#include "./Translator.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A file of a batch, with flags added to the ones of the compilation database
+struct BatchEntry {
+  std::string path;
+  std::vector<std::string> flags;
+};
+
+// Reads a manifest with one entry per line, either a path or a json object
+//   {"file": "a.cpp", "flags": ["-DN=4"]}
+// Blank lines are skipped. Returns false, with the error, if a line is invalid.
+bool readManifest(std::istream& in, std::vector<BatchEntry>& entries,
+                  std::string& error);
+
+// Translates the entries in a pool of `workers` forked processes, each one
+// translating a file after another. A worker that crashes, or takes more than
+// timeoutSeconds (0 for no limit), is killed and replaced, and its file gets
+// a record {"file": ..., "error": ...}. The other records are the ones of
+// -ndjson, written in manifest order. Returns the worst status.
+int runBatch(const clang::tooling::CompilationDatabase& compilations,
+             const std::vector<BatchEntry>& entries,
+             const TranslationOptions& options, unsigned workers,
+             unsigned timeoutSeconds, std::FILE* out);
+
+#endif // CPPTRANSLATE_BATCH_H
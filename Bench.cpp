@@ -0,0 +1,383 @@
+// Benchmark of the translation. Each example and each generated stress input
+// is translated several times in the same process, timing clang parsing, the
+// traversal of SuperastCPP and the json writer separately. The results are
+// printed as json, so they can be compared between releases.
+// With -scaling, each generated shape is translated at doubling sizes instead,
+// to see which parts of the translation grow faster than their input.
+
+#include "./Corpus.h"
+#include "./OutputArena.h"
+#include "./SuperastCheck.h"
+#include "./SuperastCPP.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static llvm::cl::OptionCategory BenchCategory("cpptranslate-bench options");
+
+static llvm::cl::opt<std::string> ExamplesDir("examples",
+    llvm::cl::desc("Directory with one input.cpp in each subdirectory"),
+    llvm::cl::value_desc("directory"), llvm::cl::init("examples"),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Iterations("n",
+    llvm::cl::desc("Times each input is translated"),
+    llvm::cl::init(5), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> StressSize("stress-size",
+    llvm::cl::desc("Size of the generated inputs (0 to skip them)"),
+    llvm::cl::init(1000), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Scaling("scaling",
+    llvm::cl::desc("Translate each shape at this many doublings of "
+                   "-stress-size, instead of the examples"),
+    llvm::cl::init(0), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::list<std::string> Shapes("shape",
+    llvm::cl::desc("Shape translated with -scaling (all by default)"),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::list<std::string> ExtraArgs("extra-arg",
+    llvm::cl::desc("Additional argument for the compiler"),
+    llvm::cl::cat(BenchCategory));
+
+// A source to translate
+struct BenchInput {
+  std::string name;
+  std::string source;
+};
+
+// Totals of all the iterations of an input
+struct BenchResult {
+  BenchResult()
+    : parseSeconds(0), traverseSeconds(0), writeSeconds(0), checkSeconds(0),
+      nodes(0), outputBytes(0), astBytes(0), failed(false) {}
+
+  std::string name;
+  double parseSeconds;
+  double traverseSeconds;
+  double writeSeconds;   // Translating to json, minus the traversal alone
+  double checkSeconds;   // Only finding the messages, as -check-only
+  uint64_t nodes;        // Objects written
+  uint64_t outputBytes;  // Compact json
+  uint64_t astBytes;     // Allocated by clang for the AST, of one iteration
+  bool failed;
+};
+
+// Drops the translation, only counts its nodes
+class CountingHandler : public JsonHandler {
+public:
+  CountingHandler() : objects(0) {}
+
+  virtual bool Null() { return true; }
+  virtual bool Bool(bool) { return true; }
+  virtual bool Int(int) { return true; }
+  virtual bool Uint(unsigned) { return true; }
+  virtual bool Int64(int64_t) { return true; }
+  virtual bool Uint64(uint64_t) { return true; }
+  virtual bool Double(double) { return true; }
+  virtual bool String(const char*, rapidjson::SizeType, bool) { return true; }
+  virtual bool StartObject() { ++objects; return true; }
+  virtual bool Key(const char*, rapidjson::SizeType, bool) { return true; }
+  virtual bool EndObject(rapidjson::SizeType) { return true; }
+  virtual bool StartArray() { return true; }
+  virtual bool EndArray(rapidjson::SizeType) { return true; }
+
+  uint64_t objects;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Every subdirectory of directory with an input.cpp, sorted by name
+static std::vector<BenchInput> readExamples(const std::string& directory) {
+  std::vector<BenchInput> inputs;
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(directory, ec), end;
+       it != end && !ec; it.increment(ec)) {
+    llvm::SmallString<128> path(it->path());
+    llvm::sys::path::append(path, "input.cpp");
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> source =
+        llvm::MemoryBuffer::getFile(path);
+    if (!source) continue;
+
+    BenchInput input;
+    input.name = llvm::sys::path::filename(it->path()).str();
+    input.source = (*source)->getBuffer().str();
+    inputs.push_back(input);
+  }
+  std::sort(inputs.begin(), inputs.end(),
+            [](const BenchInput& a, const BenchInput& b) {
+    return a.name < b.name;
+  });
+  return inputs;
+}
+
+// Inputs that stress each part of the translation with `size` elements
+static std::vector<BenchInput> generateStressInputs(unsigned size) {
+  std::vector<BenchInput> inputs;
+  for (const CorpusShape& shape : getCorpusShapes()) {
+    BenchInput input;
+    input.name = std::string("stress-") + shape.name;
+    input.source = shape.generate(getCorpusSize(shape, size));
+    inputs.push_back(input);
+  }
+  return inputs;
+}
+
+static BenchResult runInput(const BenchInput& input,
+                            const std::vector<std::string>& args) {
+  BenchResult result;
+  result.name = input.name;
+  // As in a run over many files, the output memory is kept between them
+  OutputArena arena;
+
+  for (unsigned i = 0; i < Iterations; ++i) {
+    Clock::time_point start = Clock::now();
+    std::unique_ptr<clang::ASTUnit> ast =
+        clang::tooling::buildASTFromCodeWithArgs(input.source, args,
+                                                 "input.cpp");
+    result.parseSeconds += secondsSince(start);
+    if (!ast) {
+      result.failed = true;
+      return result;
+    }
+    clang::ASTContext& context = ast->getASTContext();
+    result.astBytes = context.getASTAllocatedMemory() +
+                      context.getSideTableAllocatedMemory();
+
+    // Traversal alone
+    CountingHandler counter;
+    start = Clock::now();
+    SuperastCPP(&context, counter, SuperastCPPOptions())
+        .TraverseDecl(context.getTranslationUnitDecl());
+    const double traverseSeconds = secondsSince(start);
+    result.traverseSeconds += traverseSeconds;
+    result.nodes += counter.objects;
+
+    // Traversal and writer
+    rapidjson::StringBuffer& buffer = arena.begin();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    JsonHandlerAdapter<rapidjson::Writer<rapidjson::StringBuffer>> handler(
+        writer);
+    start = Clock::now();
+    SuperastCPP(&context, handler, SuperastCPPOptions())
+        .TraverseDecl(context.getTranslationUnitDecl());
+    result.writeSeconds +=
+        std::max(0.0, secondsSince(start) - traverseSeconds);
+    result.outputBytes += buffer.GetSize();
+    arena.end();
+
+    // Messages alone
+    CountingHandler messages;
+    start = Clock::now();
+    SuperastCheck(&context, messages, SuperastCPPOptions())
+        .TraverseDecl(context.getTranslationUnitDecl());
+    result.checkSeconds += secondsSince(start);
+  }
+  return result;
+}
+
+static double perSecond(double amount, double seconds) {
+  return seconds > 0 ? amount / seconds : 0;
+}
+
+// Translates each shape at doubling sizes, writing a point for each size
+static int writeScaling(rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer,
+                        const std::vector<std::string>& args) {
+  std::vector<const CorpusShape*> shapes;
+  for (const std::string& name : Shapes) {
+    const CorpusShape* shape = findCorpusShape(name);
+    if (!shape) {
+      llvm::errs() << "Unknown shape " << name << "\n";
+      return 1;
+    }
+    shapes.push_back(shape);
+  }
+  if (shapes.empty()) {
+    for (const CorpusShape& shape : getCorpusShapes()) shapes.push_back(&shape);
+  }
+
+  int returnValue = 0;
+  writer.Key("scaling");
+  writer.StartArray();
+  for (const CorpusShape* shape : shapes) {
+    writer.StartObject();
+    writer.Key("shape");
+    writer.String(shape->name);
+    writer.Key("points");
+    writer.StartArray();
+    unsigned previousSize = 0;
+    double previousSeconds = 0;
+    for (unsigned step = 0; step < Scaling; ++step) {
+      const unsigned size = getCorpusSize(*shape, StressSize << step);
+      if (size == previousSize) break;
+
+      BenchInput input;
+      input.name = shape->name;
+      input.source = shape->generate(size);
+      const BenchResult result = runInput(input, args);
+      if (result.failed) {
+        llvm::errs() << "Could not parse " << shape->name << " of size "
+                     << size << "\n";
+        returnValue = 1;
+        break;
+      }
+      const double translateSeconds =
+          (result.traverseSeconds + result.writeSeconds) / Iterations;
+      rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+
+      writer.StartObject();
+      writer.Key("size");
+      writer.Uint(size);
+      writer.Key("parse-seconds");
+      writer.Double(result.parseSeconds / Iterations);
+      writer.Key("translate-seconds");
+      writer.Double(translateSeconds);
+      // Exponent of the growth of the translation from the previous size:
+      // about 1 when linear, 2 when quadratic
+      writer.Key("translate-growth");
+      if (previousSize && previousSeconds > 0 && translateSeconds > 0) {
+        writer.Double(std::log(translateSeconds / previousSeconds) /
+                      std::log(double(size) / previousSize));
+      } else {
+        writer.Null();
+      }
+      writer.Key("nodes");
+      writer.Uint64(result.nodes / Iterations);
+      writer.Key("output-bytes");
+      writer.Uint64(result.outputBytes / Iterations);
+      writer.Key("ast-bytes");
+      writer.Uint64(result.astBytes);
+      writer.Key("peak-rss-kb");
+      writer.Int64(usage.ru_maxrss);
+      writer.EndObject();
+
+      previousSize = size;
+      previousSeconds = translateSeconds;
+    }
+    writer.EndArray();
+    writer.EndObject();
+  }
+  writer.EndArray();
+  return returnValue;
+}
+
+int main(int argc, const char **argv) {
+  llvm::cl::HideUnrelatedOptions(BenchCategory);
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+      "Benchmark of cpptranslate over the examples and generated inputs\n");
+
+  std::vector<std::string> args = {"-std=c++11"};
+  args.insert(args.end(), ExtraArgs.begin(), ExtraArgs.end());
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("iterations");
+  writer.Uint(Iterations);
+
+  if (Scaling > 0) {
+    const int returnValue = writeScaling(writer, args);
+    writer.EndObject();
+    std::printf("%s\n", buffer.GetString());
+    return returnValue;
+  }
+
+  std::vector<BenchInput> inputs = readExamples(ExamplesDir);
+  if (StressSize > 0) {
+    std::vector<BenchInput> stress = generateStressInputs(StressSize);
+    inputs.insert(inputs.end(), stress.begin(), stress.end());
+  }
+  if (inputs.empty()) {
+    llvm::errs() << "No inputs in " << ExamplesDir << "\n";
+    return 1;
+  }
+
+  BenchResult total;
+  int returnValue = 0;
+  const Clock::time_point start = Clock::now();
+  writer.Key("inputs");
+  writer.StartArray();
+  for (const BenchInput& input : inputs) {
+    const BenchResult result = runInput(input, args);
+    if (result.failed) {
+      llvm::errs() << "Could not parse " << input.name << "\n";
+      returnValue = 1;
+    }
+    total.parseSeconds += result.parseSeconds;
+    total.traverseSeconds += result.traverseSeconds;
+    total.writeSeconds += result.writeSeconds;
+    total.checkSeconds += result.checkSeconds;
+    total.nodes += result.nodes;
+    total.outputBytes += result.outputBytes;
+
+    writer.StartObject();
+    writer.Key("name");
+    writer.String(result.name.c_str(), result.name.size());
+    writer.Key("failed");
+    writer.Bool(result.failed);
+    writer.Key("parse-seconds");
+    writer.Double(result.parseSeconds);
+    writer.Key("traverse-seconds");
+    writer.Double(result.traverseSeconds);
+    writer.Key("write-seconds");
+    writer.Double(result.writeSeconds);
+    writer.Key("check-seconds");
+    writer.Double(result.checkSeconds);
+    writer.Key("nodes");
+    writer.Uint64(result.nodes);
+    writer.Key("output-bytes");
+    writer.Uint64(result.outputBytes);
+    writer.EndObject();
+  }
+  writer.EndArray();
+  const double wallSeconds = secondsSince(start);
+
+  const double translateSeconds = total.traverseSeconds + total.writeSeconds;
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  writer.Key("total");
+  writer.StartObject();
+  writer.Key("wall-seconds");
+  writer.Double(wallSeconds);
+  writer.Key("parse-seconds");
+  writer.Double(total.parseSeconds);
+  writer.Key("traverse-seconds");
+  writer.Double(total.traverseSeconds);
+  writer.Key("write-seconds");
+  writer.Double(total.writeSeconds);
+  writer.Key("check-seconds");
+  writer.Double(total.checkSeconds);
+  writer.Key("files-per-second");
+  writer.Double(perSecond(double(inputs.size()) * Iterations, wallSeconds));
+  writer.Key("nodes-per-second");
+  writer.Double(perSecond(total.nodes, translateSeconds));
+  writer.Key("output-mb-per-second");
+  writer.Double(perSecond(total.outputBytes / 1e6, translateSeconds));
+  writer.Key("peak-rss-kb");
+  writer.Int64(usage.ru_maxrss);
+  writer.EndObject();
+
+  writer.EndObject();
+  std::printf("%s\n", buffer.GetString());
+  return returnValue;
+}
@@ -0,0 +1,180 @@
+#include "./Bundle.h"
+#include "rapidjson/document.h"
+
+#include <algorithm>
+#include <tuple>
+
+// Blocks of a tar archive, and the fields of its headers
+static const size_t TAR_BLOCK = 512;
+static const size_t TAR_NAME = 0, TAR_NAME_SIZE = 100;
+static const size_t TAR_SIZE = 124, TAR_SIZE_SIZE = 12;
+static const size_t TAR_TYPE = 156;
+static const size_t TAR_MAGIC = 257;
+static const size_t TAR_PREFIX = 345, TAR_PREFIX_SIZE = 155;
+
+bool parseBundleEntry(const std::string& json, BundleEntry& entry) {
+  rapidjson::Document document;
+  document.Parse(json.c_str());
+  if (document.HasParseError() || !document.IsObject() ||
+      !document.HasMember("source") || !document["source"].IsString()) {
+    return false;
+  }
+
+  const rapidjson::Value& source = document["source"];
+  entry.source.assign(source.GetString(), source.GetStringLength());
+  entry.name = "input.cpp";
+  if (document.HasMember("name") && document["name"].IsString()) {
+    entry.name = document["name"].GetString();
+  }
+  entry.flags.clear();
+  if (document.HasMember("flags") && document["flags"].IsArray()) {
+    const rapidjson::Value& flags = document["flags"];
+    for (rapidjson::SizeType i = 0; i < flags.Size(); ++i) {
+      if (flags[i].IsString()) entry.flags.push_back(flags[i].GetString());
+    }
+  }
+  entry.previous.source.clear();
+  entry.previous.output.clear();
+  if (document.HasMember("previous-source") &&
+      document["previous-source"].IsString() &&
+      document.HasMember("previous-output") &&
+      document["previous-output"].IsString()) {
+    const rapidjson::Value& previousSource = document["previous-source"];
+    const rapidjson::Value& previousOutput = document["previous-output"];
+    entry.previous.source.assign(previousSource.GetString(),
+                                 previousSource.GetStringLength());
+    entry.previous.output.assign(previousOutput.GetString(),
+                                 previousOutput.GetStringLength());
+  }
+  return true;
+}
+
+// Text of a header field, up to its first NUL
+static llvm::StringRef getTarField(llvm::StringRef header, size_t offset,
+                                   size_t size) {
+  llvm::StringRef field = header.substr(offset, size);
+  return field.substr(0, field.find('\0'));
+}
+
+// Value of "path" in the records "<length> <key>=<value>\n" of a pax header,
+// where the length counts the whole record
+static std::string getPaxPath(llvm::StringRef records) {
+  std::string path;
+  while (!records.empty()) {
+    const size_t space = records.find(' ');
+    size_t length = 0;
+    if (space == llvm::StringRef::npos ||
+        records.substr(0, space).getAsInteger(10, length) ||
+        length < space + 2 || length > records.size()) {
+      break;
+    }
+    llvm::StringRef key, value;
+    std::tie(key, value) =
+        records.substr(space + 1, length - space - 2).split('=');
+    if (key == "path") path = value.str();
+    records = records.drop_front(length);
+  }
+  return path;
+}
+
+static bool isTar(llvm::StringRef data) {
+  return data.size() >= TAR_BLOCK && data.substr(TAR_MAGIC, 5) == "ustar";
+}
+
+static bool readTar(llvm::StringRef data, std::vector<BundleEntry>& entries,
+                    std::string& error) {
+  std::string longName; // Of the next entry, from a GNU or pax header
+  size_t offset = 0;
+  while (offset < data.size()) {
+    const llvm::StringRef header = data.substr(offset, TAR_BLOCK);
+    // The archive ends with blocks of zeros
+    if (header.find_first_not_of('\0') == llvm::StringRef::npos) break;
+    if (header.size() < TAR_BLOCK) {
+      error = "The tar archive is truncated";
+      return false;
+    }
+
+    unsigned long long size = 0;
+    const llvm::StringRef sizeField =
+        getTarField(header, TAR_SIZE, TAR_SIZE_SIZE).trim(" ");
+    if (sizeField.getAsInteger(8, size)) {
+      error = "Invalid size in the tar header at byte " +
+              std::to_string(offset);
+      return false;
+    }
+    offset += TAR_BLOCK;
+    if (size > data.size() - offset) {
+      error = "The tar archive is truncated";
+      return false;
+    }
+    const llvm::StringRef contents = data.substr(offset, size);
+    offset += (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+
+    const char type = header[TAR_TYPE];
+    if (type == 'L') {
+      longName = contents.substr(0, contents.find('\0')).str();
+      continue;
+    }
+    if (type == 'x') {
+      longName = getPaxPath(contents);
+      continue;
+    }
+    // Directories, links and the rest have no source
+    if (type != '0' && type != '\0') {
+      longName.clear();
+      continue;
+    }
+
+    BundleEntry entry;
+    if (!longName.empty()) entry.name.swap(longName);
+    else {
+      const llvm::StringRef prefix =
+          getTarField(header, TAR_PREFIX, TAR_PREFIX_SIZE);
+      if (!prefix.empty()) entry.name = prefix.str() + "/";
+      entry.name += getTarField(header, TAR_NAME, TAR_NAME_SIZE);
+    }
+    entry.source = contents.str();
+    entries.push_back(std::move(entry));
+  }
+  return true;
+}
+
+bool readBundle(llvm::StringRef data, std::vector<BundleEntry>& entries,
+                std::string& error) {
+  if (isTar(data)) return readTar(data, entries, error);
+
+  unsigned lineNumber = 0;
+  while (!data.empty()) {
+    llvm::StringRef line;
+    std::tie(line, data) = data.split('\n');
+    ++lineNumber;
+    if (line.trim().empty()) continue;
+
+    BundleEntry entry;
+    if (!parseBundleEntry(line.str(), entry)) {
+      error = "Line " + std::to_string(lineNumber) + " of the bundle must be "
+              "an object with a \"source\"";
+      return false;
+    }
+    entries.push_back(std::move(entry));
+  }
+  return true;
+}
+
+int translateBundle(const clang::tooling::CompilationDatabase& compilations,
+                    const std::vector<BundleEntry>& entries,
+                    const TranslationOptions& options, std::FILE* out) {
+  SourceTranslator translator(compilations, options);
+  int returnValue = 0;
+  std::string output;
+  for (const BundleEntry& entry : entries) {
+    const int status = translator.translateToString(
+        entry.name, entry.source, entry.flags, output,
+        entry.previous.output.empty() ? nullptr : &entry.previous);
+    returnValue = std::max(returnValue, status);
+    if (options.ndjson) output = dumpJsonRecord(entry.name, output);
+    std::fwrite(output.data(), 1, output.size(), out);
+    std::fflush(out);
+  }
+  return returnValue;
+}
@@ -0,0 +1,40 @@
+#ifndef CPPTRANSLATE_BUNDLE_H
+#define CPPTRANSLATE_BUNDLE_H
+
+#include "./Translator.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A source given in memory, translated as if it was the file `name`
+struct BundleEntry {
+  std::string name;
+  std::string source;
+  std::vector<std::string> flags; // Added to the ones of the database
+  PreviousTranslation previous;   // Reused if it has an output
+};
+
+// Reads a json object {"source": ..., "name": ..., "flags": [...]}, where
+// only "source" is required. The name is "input.cpp" by default. With
+// "previous-source" and "previous-output", the source is translated
+// incrementally from them.
+bool parseBundleEntry(const std::string& json, BundleEntry& entry);
+
+// Reads the sources of a bundle, either a tar archive or one json object per
+// line like the ones of parseBundleEntry. Only the regular files of an
+// archive are read. Returns false, with the error, if the bundle is invalid.
+bool readBundle(llvm::StringRef data, std::vector<BundleEntry>& entries,
+                std::string& error);
+
+// Translates the entries one after another in the same process, without
+// writing them to disk. Each one is printed as compact json, or as a
+// {"file": ..., "ast": ...} line with options.ndjson. Returns the worst
+// status.
+int translateBundle(const clang::tooling::CompilationDatabase& compilations,
+                    const std::vector<BundleEntry>& entries,
+                    const TranslationOptions& options, std::FILE* out);
+
+#endif // CPPTRANSLATE_BUNDLE_H
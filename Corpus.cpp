@@ -0,0 +1,95 @@
+#include "./Corpus.h"
+
+static const char* const HEADER =
+    "#include <iostream>\n"
+    "#include <vector>\n"
+    "using namespace std;\n\n";
+
+// Many small functions
+static std::string generateFunctions(unsigned size) {
+  std::string source = HEADER;
+  for (unsigned i = 0; i < size; ++i) {
+    const std::string n = std::to_string(i);
+    source += "int f" + n + "(int a, int b) {\n"
+        "  int c = a * " + n + " + b;\n"
+        "  if (c > a) return c - b;\n"
+        "  return c;\n"
+        "}\n";
+  }
+  source += "int main() {\n  return f0(1, 2);\n}\n";
+  return source;
+}
+
+// A single function with many statements
+static std::string generateStatements(unsigned size) {
+  std::string source = HEADER;
+  source += "int main() {\n  int x = 0;\n";
+  for (unsigned i = 0; i < size; ++i) {
+    source += "  x = x + " + std::to_string(i % 100) + ";\n";
+  }
+  source += "  cout << x << endl;\n}\n";
+  return source;
+}
+
+// A single expression, as deep as the number of operators
+static std::string generateExpression(unsigned size) {
+  std::string source = HEADER;
+  source += "int main() {\n  int x = 1;\n  int y = x";
+  for (unsigned i = 0; i < size; ++i) source += " + x";
+  source += ";\n  cout << y << endl;\n}\n";
+  return source;
+}
+
+// A long chain of print operators
+static std::string generatePrint(unsigned size) {
+  std::string source = HEADER;
+  source += "int main() {\n  int x = 1;\n  cout";
+  for (unsigned i = 0; i < size; ++i) source += " << x << \" \"";
+  source += " << endl;\n}\n";
+  return source;
+}
+
+// A long chain of else if
+static std::string generateElseIf(unsigned size) {
+  std::string source = HEADER;
+  source += "int main() {\n  int x;\n  cin >> x;\n";
+  for (unsigned i = 0; i < size; ++i) {
+    const std::string n = std::to_string(i);
+    source += std::string(i == 0 ? "  if" : "  else if") +
+        " (x == " + n + ") cout << " + n + " << endl;\n";
+  }
+  source += "}\n";
+  return source;
+}
+
+// A vector nested as many times as size. Deep ones need -ftemplate-depth.
+static std::string generateVector(unsigned size) {
+  std::string type = "int";
+  for (unsigned i = 0; i < size; ++i) type = "vector<" + type + " >";
+  std::string source = HEADER;
+  source += "int main() {\n  " + type + " v;\n  cout << v.size() << endl;\n}\n";
+  return source;
+}
+
+const std::vector<CorpusShape>& getCorpusShapes() {
+  static const std::vector<CorpusShape> shapes = {
+    {"functions", "Functions of a few statements", generateFunctions, 0},
+    {"statements", "Statements of a single function", generateStatements, 0},
+    {"expression", "Operators of a single expression", generateExpression, 0},
+    {"print", "Operands of a single cout << chain", generatePrint, 0},
+    {"else-if", "Conditions of an if/else if ladder", generateElseIf, 0},
+    {"vector", "Nesting of a vector<vector<...>> type", generateVector, 100},
+  };
+  return shapes;
+}
+
+const CorpusShape* findCorpusShape(const std::string& name) {
+  for (const CorpusShape& shape : getCorpusShapes()) {
+    if (name == shape.name) return &shape;
+  }
+  return nullptr;
+}
+
+unsigned getCorpusSize(const CorpusShape& shape, unsigned size) {
+  return shape.maxSize && size > shape.maxSize ? shape.maxSize : size;
+}
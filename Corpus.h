@@ -0,0 +1,24 @@
+#ifndef CPPTRANSLATE_CORPUS_H
+#define CPPTRANSLATE_CORPUS_H
+
+#include <string>
+#include <vector>
+
+// A kind of generated input, that grows in one direction with its size
+struct CorpusShape {
+  const char* name;
+  const char* description;
+  std::string (*generate)(unsigned size);
+  unsigned maxSize; // Largest size clang parses with its default flags, or 0
+};
+
+// Every shape, to find where the translation stops scaling
+const std::vector<CorpusShape>& getCorpusShapes();
+
+// The shape with that name, or null
+const CorpusShape* findCorpusShape(const std::string& name);
+
+// size, limited to the maxSize of the shape
+unsigned getCorpusSize(const CorpusShape& shape, unsigned size);
+
+#endif // CPPTRANSLATE_CORPUS_H
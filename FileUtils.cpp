@@ -0,0 +1,58 @@
+#include "./FileUtils.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+std::string hashKey(const std::vector<std::string>& parts) {
+  llvm::SHA1 hasher;
+  for (const std::string& part : parts) {
+    hasher.update(std::to_string(part.size()) + ":");
+    hasher.update(part);
+  }
+  return llvm::toHex(hasher.final());
+}
+
+// Writes contents to a unique temporary file next to path
+static bool writeTemporaryFile(const std::string& path,
+                               llvm::StringRef contents,
+                               llvm::SmallString<128>& tempPath) {
+  int fd;
+  if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%%%.tmp", fd, tempPath)) {
+    return false;
+  }
+
+  bool written;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << contents;
+    os.close();
+    written = !os.has_error();
+    os.clear_error();
+  }
+  if (!written) llvm::sys::fs::remove(tempPath);
+  return written;
+}
+
+bool writeFileAtomically(const std::string& path, llvm::StringRef contents) {
+  llvm::SmallString<128> tempPath;
+  if (!writeTemporaryFile(path, contents, tempPath)) return false;
+  if (llvm::sys::fs::rename(tempPath, path)) {
+    llvm::sys::fs::remove(tempPath);
+    return false;
+  }
+  return true;
+}
+
+bool writeFileIfAbsent(const std::string& path, llvm::StringRef contents) {
+  if (llvm::sys::fs::exists(path)) return true;
+  llvm::SmallString<128> tempPath;
+  if (!writeTemporaryFile(path, contents, tempPath)) return false;
+  // Unlike a rename, the link fails if path was written in the meantime
+  const std::error_code error =
+      llvm::sys::fs::create_hard_link(tempPath, path);
+  llvm::sys::fs::remove(tempPath);
+  return !error || llvm::sys::fs::exists(path);
+}
@@ -0,0 +1,21 @@
+#ifndef CPPTRANSLATE_FILE_UTILS_H
+#define CPPTRANSLATE_FILE_UTILS_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+// Hex SHA1 of all the parts. Parts are length prefixed, so splitting the same
+// bytes in a different way gives a different key.
+std::string hashKey(const std::vector<std::string>& parts);
+
+// Writes contents to a unique temporary file next to path and renames it to
+// path, so other processes sharing the directory never see half written files.
+bool writeFileAtomically(const std::string& path, llvm::StringRef contents);
+
+// Like writeFileAtomically, but an existing path is never replaced, even by
+// another process writing it at the same time. Returns true if path exists.
+bool writeFileIfAbsent(const std::string& path, llvm::StringRef contents);
+
+#endif // CPPTRANSLATE_FILE_UTILS_H
@@ -0,0 +1,57 @@
+// Writes a generated C++ input of the given shape and size, to find where the
+// translation stops scaling.
+
+#include "./Corpus.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+static llvm::cl::OptionCategory GenerateCategory("cpptranslate-gen options");
+
+static llvm::cl::opt<std::string> Shape("shape",
+    llvm::cl::desc("Shape of the input (-list-shapes to see them)"),
+    llvm::cl::init("functions"), llvm::cl::cat(GenerateCategory));
+
+static llvm::cl::opt<unsigned> Size("size",
+    llvm::cl::desc("Number of elements of the shape"),
+    llvm::cl::init(1000), llvm::cl::cat(GenerateCategory));
+
+static llvm::cl::opt<std::string> Output("o",
+    llvm::cl::desc("Output file (stdout by default)"),
+    llvm::cl::value_desc("file"), llvm::cl::init("-"),
+    llvm::cl::cat(GenerateCategory));
+
+static llvm::cl::opt<bool> ListShapes("list-shapes",
+    llvm::cl::desc("Print the available shapes"),
+    llvm::cl::cat(GenerateCategory));
+
+int main(int argc, const char **argv) {
+  llvm::cl::HideUnrelatedOptions(GenerateCategory);
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+      "Generator of large C++ inputs for cpptranslate\n");
+
+  if (ListShapes) {
+    for (const CorpusShape& shape : getCorpusShapes()) {
+      llvm::outs() << shape.name << "\t" << shape.description << "\n";
+    }
+    return 0;
+  }
+
+  const CorpusShape* shape = findCorpusShape(Shape);
+  if (!shape) {
+    llvm::errs() << "Unknown shape " << Shape << "\n";
+    return 1;
+  }
+
+  std::error_code error;
+  llvm::raw_fd_ostream out(Output, error, llvm::sys::fs::F_Text);
+  if (error) {
+    llvm::errs() << "Could not write " << Output << ": " << error.message()
+                 << "\n";
+    return 1;
+  }
+  out << shape->generate(Size);
+  return 0;
+}
@@ -0,0 +1,414 @@
+#include "./Incremental.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+// If a line begins at offset, with lines ending as clang counts them
+static bool isLineStart(llvm::StringRef text, size_t offset) {
+  if (offset == 0) return true;
+  const char previous = text[offset - 1];
+  if (previous == '\n') return true;
+  return previous == '\r' && (offset == text.size() || text[offset] != '\n');
+}
+
+// Line breaks between two line starts
+static int countLines(llvm::StringRef text, size_t begin, size_t end) {
+  int lines = 0;
+  for (size_t i = begin; i < end; ++i) {
+    if (text[i] == '\r') ++lines;
+    else if (text[i] == '\n' && (i == 0 || text[i - 1] != '\r')) ++lines;
+  }
+  return lines;
+}
+
+// Members of a node that must be the same in both outputs
+static const unsigned ID_FIELD = 1;
+static const unsigned LINE_FIELD = 2;
+static const unsigned COLUMN_FIELD = 4;
+static const unsigned OFFSET_FIELD = 8;
+
+static bool isKey(const char* str, rapidjson::SizeType length,
+                  const char* key) {
+  return length == std::strlen(key) && std::memcmp(str, key, length) == 0;
+}
+
+namespace {
+
+// Lines [begin, end) and offsets of the previous source that were edited
+struct EditedRegion {
+  int line;
+  int endLine;
+  int offset;
+  int endOffset;
+};
+
+// Finds the statements of a previous translation, with the position that
+// identifies each one, and its largest id. The root must be an object whose
+// "statements" are objects.
+class PreviousOutputReader
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
+                                          PreviousOutputReader> {
+public:
+  struct Statement {
+    size_t begin; // Bytes of its object
+    size_t end;
+    int line;
+    int offset;
+    bool inEdit;     // Some of its nodes are inside the edited region
+    unsigned fields; // FIELD_ bits of its own members
+  };
+
+  PreviousOutputReader(const rapidjson::MemoryStream& stream,
+                       const EditedRegion& region)
+    : maxId(0), stream(stream), region(region), depth(0), inStatements(false),
+      key(OtherKey) {}
+
+  bool Default() { return scalar(-1); }
+  bool Int(int i) { return scalar(i); }
+  bool Uint(unsigned u) {
+    if (key == IdKey) maxId = std::max(maxId, u);
+    return scalar(static_cast<int>(u));
+  }
+
+  bool StartObject() {
+    if (isStatement()) {
+      // The iterative parser is still on the opening brace
+      Statement statement = {stream.Tell(), 0, -1, -1, false, 0};
+      statements.push_back(statement);
+    }
+    key = OtherKey;
+    ++depth;
+    return true;
+  }
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    key = OtherKey;
+    if (isKey(str, length, "id")) key = IdKey;
+    else if (depth == 1 && isKey(str, length, "statements")) {
+      key = StatementsKey;
+    }
+    else if (inStatements && isKey(str, length, "line")) key = LineKey;
+    else if (inStatements && isKey(str, length, "offset")) key = OffsetKey;
+    else if (inStatements && isKey(str, length, "column")) key = ColumnKey;
+    if (inStatements && depth == 3) {
+      if (key == IdKey) statements.back().fields |= ID_FIELD;
+      else if (key == LineKey) statements.back().fields |= LINE_FIELD;
+      else if (key == ColumnKey) statements.back().fields |= COLUMN_FIELD;
+      else if (key == OffsetKey) statements.back().fields |= OFFSET_FIELD;
+    }
+    return true;
+  }
+  bool EndObject(rapidjson::SizeType) {
+    --depth;
+    // And on the closing one
+    if (isStatement()) statements.back().end = stream.Tell() + 1;
+    return true;
+  }
+  bool StartArray() {
+    if (depth == 0 || isStatement()) return false;
+    if (depth == 1 && key == StatementsKey) inStatements = true;
+    key = OtherKey;
+    ++depth;
+    return true;
+  }
+  bool EndArray(rapidjson::SizeType) {
+    --depth;
+    if (depth == 1) inStatements = false;
+    return true;
+  }
+
+  std::vector<Statement> statements;
+  unsigned maxId;
+
+private:
+  enum KeyKind {
+    OtherKey, IdKey, StatementsKey, LineKey, ColumnKey, OffsetKey
+  };
+
+  bool isStatement() const { return inStatements && depth == 2; }
+
+  bool scalar(int number) {
+    if (depth == 0 || isStatement()) return false;
+    if (key == LineKey) {
+      if (depth == 3) statements.back().line = number;
+      if (number >= region.line && number < region.endLine) {
+        statements.back().inEdit = true;
+      }
+    }
+    else if (key == OffsetKey) {
+      if (depth == 3) statements.back().offset = number;
+      if (number >= region.offset && number < region.endOffset) {
+        statements.back().inEdit = true;
+      }
+    }
+    key = OtherKey;
+    return true;
+  }
+
+  const rapidjson::MemoryStream& stream;
+  const EditedRegion& region;
+  unsigned depth; // Open objects and arrays
+  bool inStatements;
+  KeyKind key;    // Of the value that comes next
+};
+
+// Positions from `from` on are moved by delta
+struct PositionShift {
+  int from;
+  int delta;
+};
+
+// Writes a statement of the previous output to the emitter, moving the lines
+// and offsets past the edit. The ones before it, as the field of a struct
+// declared above, stay.
+class StatementCopier
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, StatementCopier> {
+public:
+  StatementCopier(JsonEmitter& out, const PositionShift& lines,
+                  const PositionShift& offsets)
+    : out(out), lines(lines), offsets(offsets), shift(nullptr) {}
+
+  bool Null() { out.Null(); return next(); }
+  bool Bool(bool b) { out.Bool(b); return next(); }
+  bool Int(int i) { out.Int(i); return next(); }
+  // Unknown positions are -1, an Int, and stay
+  bool Uint(unsigned u) {
+    const int position = static_cast<int>(u);
+    if (shift && shift->delta && position >= shift->from) {
+      out.Int(position + shift->delta);
+    }
+    else out.Uint(u);
+    return next();
+  }
+  bool Int64(int64_t i) { out.Int64(i); return next(); }
+  bool Uint64(uint64_t u) { out.Uint64(u); return next(); }
+  bool Double(double d) { out.Double(d); return next(); }
+  bool String(const char* str, rapidjson::SizeType length, bool) {
+    out.String(str, length, true);
+    return next();
+  }
+  bool StartObject() { out.StartObject(); return next(); }
+  bool Key(const char* str, rapidjson::SizeType length, bool) {
+    if (isKey(str, length, "line")) shift = &lines;
+    else if (isKey(str, length, "offset")) shift = &offsets;
+    out.Key(str, length, true);
+    return true;
+  }
+  bool EndObject(rapidjson::SizeType) { out.EndObject(); return true; }
+  bool StartArray() { out.StartArray(); return next(); }
+  bool EndArray(rapidjson::SizeType) { out.EndArray(); return true; }
+
+private:
+  bool next() {
+    shift = nullptr;
+    return true;
+  }
+
+  JsonEmitter& out;
+  const PositionShift& lines;
+  const PositionShift& offsets;
+  const PositionShift* shift; // Of the value that comes next
+};
+
+} // namespace
+
+IncrementalReuse::IncrementalReuse(llvm::StringRef previousSource,
+                                   llvm::StringRef previousOutput,
+                                   llvm::StringRef source,
+                                   const SuperastCPPOptions& options)
+    : previousSource(previousSource),
+      previousOutput(previousOutput),
+      source(source),
+      fields(0),
+      byOffset(options.positions == PositionFormat::Offset),
+      firstId(0),
+      sourceManager(nullptr) {
+  // Common prefix and suffix, which cannot overlap in either source
+  const size_t common = std::min(previousSource.size(), source.size());
+  size_t prefix = 0;
+  while (prefix < common && previousSource[prefix] == source[prefix]) ++prefix;
+  size_t suffix = 0;
+  while (suffix < common - prefix &&
+         previousSource[previousSource.size() - 1 - suffix] ==
+             source[source.size() - 1 - suffix]) {
+    ++suffix;
+  }
+  // Same members that SuperastCPP writes
+  if (options.fields.id) fields |= ID_FIELD;
+  if (options.fields.line && !byOffset) fields |= LINE_FIELD;
+  if (options.fields.column &&
+      options.positions == PositionFormat::LineColumn) {
+    fields |= COLUMN_FIELD;
+  }
+  if (options.fields.offset && byOffset) fields |= OFFSET_FIELD;
+
+  deltaOffset = static_cast<int>(source.size()) -
+                static_cast<int>(previousSource.size());
+
+  // Widened to whole lines of both sources, so the columns of the text after
+  // the edit do not change
+  size_t begin = prefix;
+  while (!isLineStart(source, begin) || !isLineStart(previousSource, begin)) {
+    --begin;
+  }
+  size_t end = source.size() - suffix;
+  while (end < source.size() &&
+         (!isLineStart(source, end) ||
+          !isLineStart(previousSource, end - deltaOffset))) {
+    ++end;
+  }
+  editBegin = static_cast<int>(begin);
+  editEnd = static_cast<int>(end);
+  deltaLines = countLines(source, begin, end) -
+               countLines(previousSource, begin, end - deltaOffset);
+  editLine = countLines(source, 0, begin) + 1;
+  previousEndLine = countLines(previousSource, 0, end - deltaOffset) + 1;
+}
+
+IncrementalReuse::~IncrementalReuse() {
+}
+
+bool IncrementalReuse::readPreviousOutput() {
+  elements.clear();
+  rapidjson::MemoryStream stream(previousOutput.data(), previousOutput.size());
+  const EditedRegion region = {editLine, previousEndLine, editBegin,
+                               editEnd - deltaOffset};
+  PreviousOutputReader reader(stream, region);
+  rapidjson::Reader parser;
+  if (!parser.Parse<rapidjson::kParseIterativeFlag>(stream, reader)) {
+    return false;
+  }
+
+  // Statements are found by the position the options write, and their
+  // copies must have the same members as the translated ones
+  if (!(fields & (byOffset ? OFFSET_FIELD : LINE_FIELD))) return false;
+  for (const PreviousOutputReader::Statement& statement : reader.statements) {
+    if (statement.fields != fields) return false;
+    const int position = byOffset ? statement.offset : statement.line;
+    if (position < 0) return false;
+    const Element element = {statement.begin, statement.end,
+                             statement.inEdit};
+    elements.insert(std::make_pair(position, element));
+  }
+  firstId = reader.maxId + 1;
+  return true;
+}
+
+bool IncrementalReuse::begin(clang::ASTContext& context,
+                             clang::TranslationUnitDecl* unitDecl) {
+  if (!readPreviousOutput()) return false;
+
+  // The preprocessor can change any declaration
+  const llvm::StringRef edited = source.slice(editBegin, editEnd);
+  const llvm::StringRef previousEdited =
+      previousSource.slice(editBegin, editEnd - deltaOffset);
+  if (edited.find('#') != llvm::StringRef::npos ||
+      previousEdited.find('#') != llvm::StringRef::npos ||
+      source.substr(0, editBegin).rtrim("\r\n").endswith("\\") ||
+      edited.rtrim("\r\n").endswith("\\") ||
+      previousEdited.rtrim("\r\n").endswith("\\")) {
+    return false;
+  }
+
+  sourceManager = &context.getSourceManager();
+  positions.reset(new SourcePositions(*sourceManager));
+  findExpansions();
+
+  // Only function definitions can be translated on their own
+  for (auto declaration : unitDecl->decls()) {
+    if (!sourceManager->isInMainFile(declaration->getLocStart())) continue;
+    DeclRange range;
+    if (!getRange(declaration, range)) return false;
+    if (isEdited(range) && !llvm::isa<clang::FunctionDecl>(declaration)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IncrementalReuse::copy(clang::Decl* decl, JsonEmitter& out) {
+  // Its statement is identified by the position where it begins
+  if (!sourceManager->isInMainFile(decl->getLocStart()) ||
+      decl->getLocStart().isMacroID()) {
+    return false;
+  }
+  DeclRange range;
+  if (!getRange(decl, range) || isEdited(range)) return false;
+
+  // Past the edit, the positions move. The ones of macros could be in
+  // another file.
+  const bool moved = range.begin >= editEnd &&
+                     (deltaLines != 0 || deltaOffset != 0);
+  if (moved && hasExpansions(range)) return false;
+  const PositionShift lines = {previousEndLine, moved ? deltaLines : 0};
+  const PositionShift offsets = {editEnd - deltaOffset,
+                                 moved ? deltaOffset : 0};
+
+  int first = byOffset ? range.begin : range.line;
+  int last = byOffset ? range.end - 1 : range.endLine;
+  if (range.begin >= editEnd) {
+    const int delta = byOffset ? deltaOffset : deltaLines;
+    first -= delta;
+    last -= delta;
+  }
+
+  // All the statements it was translated into, as a group of declarations
+  // gives one for each
+  auto it = elements.lower_bound(first);
+  const auto stop = elements.upper_bound(last);
+  for (auto element = it; element != stop; ++element) {
+    if (element->second.inEdit) return false;
+  }
+  while (it != stop) {
+    const Element& element = it->second;
+    rapidjson::MemoryStream stream(previousOutput.data() + element.begin,
+                                   element.end - element.begin);
+    StatementCopier copier(out, lines, offsets);
+    rapidjson::Reader parser;
+    parser.Parse<rapidjson::kParseIterativeFlag>(stream, copier);
+    it = elements.erase(it);
+  }
+  return true;
+}
+
+// Range where it is expanded, as the edit can only be found there
+bool IncrementalReuse::getRange(clang::Decl* decl, DeclRange& range) {
+  const SourcePositions::Position begin =
+      positions->get(sourceManager->getExpansionLoc(decl->getLocStart()));
+  const SourcePositions::Position end =
+      positions->get(sourceManager->getExpansionLoc(decl->getLocEnd()));
+  if (begin.offset < 0 || end.offset < begin.offset) return false;
+  range.begin = begin.offset;
+  range.end = end.offset + 1;
+  range.line = begin.line;
+  range.endLine = end.line;
+  return true;
+}
+
+// Also the ones that span lines that were removed
+bool IncrementalReuse::isEdited(const DeclRange& range) const {
+  return range.begin < editEnd && range.end > editBegin;
+}
+
+bool IncrementalReuse::hasExpansions(const DeclRange& range) const {
+  auto it = std::lower_bound(expansions.begin(), expansions.end(),
+                             range.begin);
+  return it != expansions.end() && *it < range.end;
+}
+
+void IncrementalReuse::findExpansions() {
+  expansions.clear();
+  const clang::FileID mainFile = sourceManager->getMainFileID();
+  for (unsigned i = 0; i < sourceManager->local_sloc_entry_size(); ++i) {
+    const clang::SrcMgr::SLocEntry& entry = sourceManager->getLocalSLocEntry(i);
+    if (!entry.isExpansion()) continue;
+    const std::pair<clang::FileID, unsigned> decomposed =
+        sourceManager->getDecomposedExpansionLoc(
+            entry.getExpansion().getExpansionLocStart());
+    if (decomposed.first == mainFile) {
+      expansions.push_back(static_cast<int>(decomposed.second));
+    }
+  }
+  std::sort(expansions.begin(), expansions.end());
+}
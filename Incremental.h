@@ -0,0 +1,81 @@
+#ifndef CPPTRANSLATE_INCREMENTAL_H
+#define CPPTRANSLATE_INCREMENTAL_H
+
+#include "./SourcePositions.h"
+#include "./SuperastCPP.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+// Copies the top-level statements of a previous translation of the same
+// file, when its source only changed inside function definitions.
+//
+// The sources are compared as a single edited region of whole lines. The
+// statements before and after it are copied, with the positions past the edit
+// moved, and the functions it touches are translated again with ids after all
+// the ones of the previous translation. A statement with a position inside
+// the edit, or one past it that uses macros, is translated again too. An edit
+// of another kind of declaration or of a preprocessor line translates
+// everything, as does a previous output whose statements lack the id and
+// position members that options write, or have others.
+class IncrementalReuse : public StatementReuse {
+public:
+  // The strings must outlive the translation. previousOutput is json, from
+  // a translation with the same options.
+  IncrementalReuse(llvm::StringRef previousSource,
+                   llvm::StringRef previousOutput, llvm::StringRef source,
+                   const SuperastCPPOptions& options);
+  ~IncrementalReuse();
+
+  virtual bool begin(clang::ASTContext& context,
+                     clang::TranslationUnitDecl* unitDecl);
+  virtual unsigned getFirstId() const { return firstId; }
+  virtual bool copy(clang::Decl* decl, JsonEmitter& out);
+
+private:
+  // Bytes of a statement of the previous output
+  struct Element {
+    size_t begin;
+    size_t end;
+    bool inEdit; // Some of its positions are inside the previous edit
+  };
+
+  // Where a declaration is in the new source
+  struct DeclRange {
+    int begin;
+    int end; // Past the first character of its last token
+    int line;
+    int endLine;
+  };
+
+  bool readPreviousOutput();
+  bool getRange(clang::Decl* decl, DeclRange& range);
+  bool isEdited(const DeclRange& range) const;
+  bool hasExpansions(const DeclRange& range) const;
+  void findExpansions();
+
+  llvm::StringRef previousSource;
+  llvm::StringRef previousOutput;
+  llvm::StringRef source;
+
+  // The edit, in the new source. The previous one ends at editEnd - delta.
+  int editBegin;
+  int editEnd;
+  int deltaOffset;
+  int deltaLines;
+  int editLine;         // First line of the edit, in both sources
+  int previousEndLine;  // First line past the edit, in the previous source
+
+  unsigned fields; // Members of each statement, the FIELD_ bits
+  bool byOffset;   // Statements are found by their offset, or by their line
+  std::multimap<int, Element> elements;
+  unsigned firstId;
+
+  const clang::SourceManager* sourceManager;
+  std::unique_ptr<SourcePositions> positions;
+  std::vector<int> expansions; // Offsets of the macros used in the main file
+};
+
+#endif // CPPTRANSLATE_INCREMENTAL_H
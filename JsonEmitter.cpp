@@ -0,0 +1,234 @@
+#include "./JsonEmitter.h"
+
+#include <cstring>
+
+JsonEmitter::JsonEmitter(JsonHandler& handler)
+    : handler(handler),
+      depth(0),
+      discardFrames(0),
+      singleFrames(0) {
+}
+
+void JsonEmitter::Null() {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::NULL_VALUE);
+  else handler.Null();
+}
+
+void JsonEmitter::Bool(bool b) {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::BOOL).b = b;
+  else handler.Bool(b);
+}
+
+void JsonEmitter::Int(int i) {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::INT).i = i;
+  else handler.Int(i);
+}
+
+void JsonEmitter::Uint(unsigned u) {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::UINT).u = u;
+  else handler.Uint(u);
+}
+
+void JsonEmitter::Int64(int64_t i) {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::INT64).i64 = i;
+  else handler.Int64(i);
+}
+
+void JsonEmitter::Uint64(uint64_t u) {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::UINT64).u64 = u;
+  else handler.Uint64(u);
+}
+
+void JsonEmitter::Double(double d) {
+  if (!startValue()) return;
+  if (isHolding()) hold(Event::DOUBLE).d = d;
+  else handler.Double(d);
+}
+
+void JsonEmitter::String(const char* str, rapidjson::SizeType length,
+                         bool copy) {
+  if (!startValue()) return;
+  if (isHolding()) holdString(Event::STRING, str, length, copy);
+  else handler.String(str, length, copy);
+}
+
+void JsonEmitter::String(const char* str) {
+  String(str, std::strlen(str), false);
+}
+
+void JsonEmitter::StartObject() {
+  if (startValue()) {
+    if (isHolding()) hold(Event::START_OBJECT);
+    else handler.StartObject();
+  }
+  ++depth;
+}
+
+void JsonEmitter::Key(const char* key) {
+  if (!isDropping()) writeKey(key, std::strlen(key), false);
+}
+
+void JsonEmitter::Key(const char* key, rapidjson::SizeType length, bool copy) {
+  if (!isDropping()) writeKey(key, length, copy);
+}
+
+void JsonEmitter::EndObject() {
+  if (!endComposite()) return;
+  if (isHolding()) hold(Event::END_OBJECT);
+  else handler.EndObject(0);
+}
+
+void JsonEmitter::StartArray() {
+  if (startValue()) {
+    if (isHolding()) hold(Event::START_ARRAY);
+    else handler.StartArray();
+  }
+  ++depth;
+}
+
+void JsonEmitter::EndArray() {
+  if (!endComposite()) return;
+  if (isHolding()) hold(Event::END_ARRAY);
+  else handler.EndArray(0);
+}
+
+void JsonEmitter::beginMember(const char* key, bool optional) {
+  pushFrame(true, !optional, false, key);
+}
+
+void JsonEmitter::beginValue() {
+  pushFrame(true, true, false, nullptr);
+}
+
+void JsonEmitter::beginElements(bool nullIfEmpty) {
+  pushFrame(false, nullIfEmpty, false, nullptr);
+}
+
+void JsonEmitter::beginDiscard() {
+  pushFrame(false, false, true, nullptr);
+}
+
+bool JsonEmitter::inElements() const {
+  return !frames.empty() && frames.back().depth == depth &&
+      !frames.back().single;
+}
+
+void JsonEmitter::markFlattened() {
+  if (inElements()) frames.back().fillNull = false;
+}
+
+void JsonEmitter::pushFrame(bool single, bool fillNull, bool discard,
+                            const char* key) {
+  Frame frame;
+  frame.depth = depth;
+  frame.count = 0;
+  frame.single = single;
+  frame.fillNull = fillNull;
+  frame.discard = discard;
+  frame.key = key;
+  frame.valueEvent = 0;
+  frame.valueString = 0;
+  frames.push_back(frame);
+  if (discard) ++discardFrames;
+  if (single) ++singleFrames;
+}
+
+void JsonEmitter::endFrame() {
+  if (frames.back().count == 0 && frames.back().fillNull) Null();
+  if (frames.back().discard) --discardFrames;
+  if (frames.back().single) --singleFrames;
+  frames.pop_back();
+  if (!isHolding() && !events.empty()) release();
+}
+
+bool JsonEmitter::startValue() {
+  if (isDropping()) return false;
+
+  // Every frame opened at this depth receives the value. A single frame
+  // already holding one takes it back, key aside.
+  for (auto it = frames.rbegin(); it != frames.rend() && it->depth == depth;
+       ++it) {
+    if (it->single && it->count > 0) {
+      events.resize(it->valueEvent);
+      strings.resize(it->valueString);
+    }
+  }
+  for (auto it = frames.rbegin(); it != frames.rend() && it->depth == depth;
+       ++it) {
+    if (it->key) {
+      writeKey(it->key, std::strlen(it->key), false);
+      it->key = nullptr;
+    }
+    if (it->single && it->count == 0) {
+      it->valueEvent = events.size();
+      it->valueString = strings.size();
+    }
+    ++it->count;
+  }
+  return true;
+}
+
+bool JsonEmitter::endComposite() {
+  --depth;
+  return !isDropping();
+}
+
+JsonEmitter::Event& JsonEmitter::hold(Event::Kind kind) {
+  events.emplace_back();
+  Event& event = events.back();
+  event.kind = kind;
+  return event;
+}
+
+void JsonEmitter::holdString(Event::Kind kind, const char* str,
+                             rapidjson::SizeType length, bool copy) {
+  Event& event = hold(kind);
+  event.length = length;
+  event.str = copy ? nullptr : str;
+  if (!copy) return;
+  // The data of strings may move, so only the offset is kept
+  event.offset = strings.size();
+  strings.insert(strings.end(), str, str + length);
+}
+
+void JsonEmitter::writeKey(const char* key, rapidjson::SizeType length,
+                           bool copy) {
+  if (isHolding()) holdString(Event::KEY, key, length, copy);
+  else handler.Key(key, length, copy);
+}
+
+void JsonEmitter::release() {
+  for (const Event& event : events) {
+    const char* str = event.str;
+    if (!str && (event.kind == Event::STRING || event.kind == Event::KEY)) {
+      str = strings.data() + event.offset;
+    }
+    switch (event.kind) {
+      case Event::NULL_VALUE: handler.Null(); break;
+      case Event::BOOL: handler.Bool(event.b); break;
+      case Event::INT: handler.Int(event.i); break;
+      case Event::UINT: handler.Uint(event.u); break;
+      case Event::INT64: handler.Int64(event.i64); break;
+      case Event::UINT64: handler.Uint64(event.u64); break;
+      case Event::DOUBLE: handler.Double(event.d); break;
+      case Event::STRING:
+        handler.String(str, event.length, event.str == nullptr);
+        break;
+      case Event::KEY:
+        handler.Key(str, event.length, event.str == nullptr);
+        break;
+      case Event::START_OBJECT: handler.StartObject(); break;
+      case Event::END_OBJECT: handler.EndObject(0); break;
+      case Event::START_ARRAY: handler.StartArray(); break;
+      case Event::END_ARRAY: handler.EndArray(0); break;
+    }
+  }
+  events.clear();
+  strings.clear();
+}
@@ -0,0 +1,181 @@
+#ifndef CPPTRANSLATE_JSON_EMITTER_H
+#define CPPTRANSLATE_JSON_EMITTER_H
+
+// RapidJson library for JSON
+#include "rapidjson/rapidjson.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Receives the translation as a stream of SAX events, the same ones of a
+// rapidjson Handler, so the output format can be chosen at runtime.
+class JsonHandler {
+public:
+  virtual ~JsonHandler() {}
+
+  virtual bool Null() = 0;
+  virtual bool Bool(bool b) = 0;
+  virtual bool Int(int i) = 0;
+  virtual bool Uint(unsigned u) = 0;
+  virtual bool Int64(int64_t i) = 0;
+  virtual bool Uint64(uint64_t u) = 0;
+  virtual bool Double(double d) = 0;
+  virtual bool String(const char* str, rapidjson::SizeType length,
+                      bool copy) = 0;
+  virtual bool StartObject() = 0;
+  virtual bool Key(const char* str, rapidjson::SizeType length, bool copy) = 0;
+  virtual bool EndObject(rapidjson::SizeType memberCount) = 0;
+  virtual bool StartArray() = 0;
+  virtual bool EndArray(rapidjson::SizeType elementCount) = 0;
+};
+
+// Forwards the events to any rapidjson handler (Writer, PrettyWriter...)
+template <typename Handler>
+class JsonHandlerAdapter : public JsonHandler {
+public:
+  explicit JsonHandlerAdapter(Handler& handler) : handler(handler) {}
+
+  virtual bool Null() { return handler.Null(); }
+  virtual bool Bool(bool b) { return handler.Bool(b); }
+  virtual bool Int(int i) { return handler.Int(i); }
+  virtual bool Uint(unsigned u) { return handler.Uint(u); }
+  virtual bool Int64(int64_t i) { return handler.Int64(i); }
+  virtual bool Uint64(uint64_t u) { return handler.Uint64(u); }
+  virtual bool Double(double d) { return handler.Double(d); }
+  virtual bool String(const char* str, rapidjson::SizeType length,
+                      bool copy) {
+    return handler.String(str, length, copy);
+  }
+  virtual bool StartObject() { return handler.StartObject(); }
+  virtual bool Key(const char* str, rapidjson::SizeType length, bool copy) {
+    return handler.Key(str, length, copy);
+  }
+  virtual bool EndObject(rapidjson::SizeType memberCount) {
+    return handler.EndObject(memberCount);
+  }
+  virtual bool StartArray() { return handler.StartArray(); }
+  virtual bool EndArray(rapidjson::SizeType elementCount) {
+    return handler.EndArray(elementCount);
+  }
+
+private:
+  Handler& handler;
+};
+
+
+// Writes the events of the visitor to a JsonHandler, in the same order as
+// they are produced. A translated node does not know in advance whether it
+// emits zero, one or many values, so its parent opens a frame that says what
+// to do with them:
+//  - a value (or member) frame keeps the last value, as replacing a DOM value
+//    would, and writes null if there is none. What they emit is held until
+//    the outermost one ends, so a later value can take back the previous one.
+//  - an elements frame flattens any number of values into the enclosing array.
+//  - a discard frame drops everything, to keep the ids of skipped nodes.
+class JsonEmitter {
+public:
+  explicit JsonEmitter(JsonHandler& handler);
+
+  void Null();
+  void Bool(bool b);
+  void Int(int i);
+  void Uint(unsigned u);
+  void Int64(int64_t i);
+  void Uint64(uint64_t u);
+  void Double(double d);
+  // Without copy, str must outlive the handler, as clang names and literals
+  // do while the ASTContext lives
+  void String(const char* str, rapidjson::SizeType length, bool copy = true);
+  // A constant string, never copied
+  void String(const char* str);
+  void StartObject();
+  void Key(const char* key);
+  // A key that may not outlive the call, unless copy is false
+  void Key(const char* key, rapidjson::SizeType length, bool copy);
+  void EndObject();
+  void StartArray();
+  void EndArray();
+
+  // The value of the member `key` comes from a traversal. If optional, the
+  // member is left out when nothing is emitted, otherwise it is null.
+  void beginMember(const char* key, bool optional = false);
+  void endMember() { endFrame(); }
+
+  // Exactly one value
+  void beginValue();
+  void endValue() { endFrame(); }
+
+  // Values are flattened into the enclosing array
+  void beginElements(bool nullIfEmpty);
+  void endElements() { endFrame(); }
+
+  // Nothing is written until endDiscard
+  void beginDiscard();
+  void endDiscard() { endFrame(); }
+
+  // If the values emitted now are flattened into an array
+  bool inElements() const;
+  // A node is flattening its values here, so the elements frame does not get
+  // a null even if there are none, as an empty array would not
+  void markFlattened();
+
+private:
+  struct Frame {
+    unsigned depth;   // Nesting of the values of this frame
+    unsigned count;   // Values already emitted in this frame
+    bool single;      // Each value replaces the previous one
+    bool fillNull;    // Emit null if the frame ends without values
+    bool discard;     // Drop every value
+    const char* key;  // Written before the first value, if any
+    size_t valueEvent;  // Where its value begins in events, if single
+    size_t valueString; // and in strings
+  };
+
+  // An event held while a single frame is open
+  struct Event {
+    enum Kind {
+      NULL_VALUE, BOOL, INT, UINT, INT64, UINT64, DOUBLE, STRING, KEY,
+      START_OBJECT, END_OBJECT, START_ARRAY, END_ARRAY
+    };
+    Kind kind;
+    union {
+      bool b;
+      int i;
+      unsigned u;
+      int64_t i64;
+      uint64_t u64;
+      double d;
+    };
+    const char* str;  // Not copied, or null if it is in strings
+    size_t offset;    // Of the copy in strings
+    rapidjson::SizeType length;
+  };
+
+  void pushFrame(bool single, bool fillNull, bool discard, const char* key);
+  void endFrame();
+  // Called before a value starts. Returns false if it must be dropped.
+  bool startValue();
+  // Called after an object or array is closed. Returns false if dropped.
+  bool endComposite();
+  bool isDropping() const { return discardFrames > 0; }
+
+  bool isHolding() const { return singleFrames > 0; }
+  Event& hold(Event::Kind kind);
+  void holdString(Event::Kind kind, const char* str,
+                  rapidjson::SizeType length, bool copy);
+  void writeKey(const char* key, rapidjson::SizeType length, bool copy);
+  // Writes the held events to the handler
+  void release();
+
+  JsonHandler& handler;
+  std::vector<Frame> frames;
+  unsigned depth;         // Open objects and arrays
+  unsigned discardFrames; // Open discard frames
+  unsigned singleFrames;  // Open value and member frames
+  std::vector<Event> events;
+  std::vector<char> strings; // Copies of the held strings
+};
+
+#endif // CPPTRANSLATE_JSON_EMITTER_H
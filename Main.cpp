@@ -0,0 +1,339 @@
+#include "./SuperastCPP.h"
+#include "./Batch.h"
+#include "./Bundle.h"
+#include "./PreambleCache.h"
+#include "./ResultCache.h"
+#include "./Server.h"
+#include "./Stats.h"
+#include "./Translator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// Custom category for command-line option
+static llvm::cl::OptionCategory SuperastCPPCategory("cpptranslate options");
+
+static llvm::cl::opt<unsigned> Jobs("j",
+    llvm::cl::desc("Number of files translated in parallel (0 for one per core)"),
+    llvm::cl::init(1), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<OutputFormat> Format("format",
+    llvm::cl::desc("Format of the translation"),
+    llvm::cl::values(
+        clEnumValN(OutputFormat::Compact, "compact",
+                   "A single line (default)"),
+        clEnumValN(OutputFormat::Pretty, "pretty", "Indented"),
+        clEnumValN(OutputFormat::MsgPack, "msgpack",
+                   "MessagePack, with the same schema as the json")),
+    llvm::cl::init(OutputFormat::Compact), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<PositionFormat> Positions("positions",
+    llvm::cl::desc("Position written in each node"),
+    llvm::cl::values(
+        clEnumValN(PositionFormat::LineColumn, "line-column",
+                   "Line and column (default)"),
+        clEnumValN(PositionFormat::Line, "line", "Only the line"),
+        clEnumValN(PositionFormat::Offset, "offset",
+                   "Only the byte offset in the file")),
+    llvm::cl::init(PositionFormat::LineColumn),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> Fields("fields",
+    llvm::cl::desc("Comma separated fields left out of each node (-name) or "
+                   "written (name): id, line, column, offset, data-type. "
+                   "Positions not chosen by -positions are rejected"),
+    llvm::cl::value_desc("fields"), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<bool> NDJson("ndjson",
+    llvm::cl::desc("Print one line {\"file\": ..., \"ast\": ...} per input file"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<bool> Stream("stream",
+    llvm::cl::desc("Print one line {\"file\": ..., \"statement\": ...} per "
+                   "top-level statement, as soon as it is translated"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<bool> CheckOnly("check-only",
+    llvm::cl::desc("Print only the array of error and warning messages of each "
+                   "file, without translating it"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<bool> ServeStdio("serve-stdio",
+    llvm::cl::desc("Translate length-prefixed requests from stdin until it is "
+                   "closed, instead of the given files"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> BatchManifest("batch",
+    llvm::cl::desc("Translate the files of a manifest (- for stdin) in -j "
+                   "worker processes, one record per file"),
+    llvm::cl::value_desc("manifest"), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<unsigned> Timeout("timeout",
+    llvm::cl::desc("With -batch, seconds a file can take before its worker is "
+                   "killed (60 by default, 0 for no limit)"),
+    llvm::cl::init(60), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<bool> Stdin("stdin",
+    llvm::cl::desc("Translate the source read from stdin, instead of the given "
+                   "files"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> StdinName("stdin-name",
+    llvm::cl::desc("With -stdin, file name the source is translated as"),
+    llvm::cl::value_desc("name"), llvm::cl::init("input.cpp"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> PreviousSource("previous-source",
+    llvm::cl::desc("With -stdin, source of the last translation. The "
+                   "statements that did not change are copied from "
+                   "-previous-output"),
+    llvm::cl::value_desc("file"), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> PreviousOutput("previous-output",
+    llvm::cl::desc("With -stdin, compact json of the last translation"),
+    llvm::cl::value_desc("file"), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> Bundle("bundle",
+    llvm::cl::desc("Translate the sources of a tar archive or json lines "
+                   "(- for stdin) in memory, one record per source"),
+    llvm::cl::value_desc("bundle"), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> PreambleCacheDir("preamble-cache",
+    llvm::cl::desc("Directory where the precompiled #include preambles are "
+                   "kept and reused"),
+    llvm::cl::value_desc("directory"), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<bool> SkipExternalBodies("skip-external-bodies",
+    llvm::cl::desc("Do not parse the function bodies of the included headers"),
+    llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> CacheDir("cache-dir",
+    llvm::cl::desc("Directory where translations are kept, and reused when the "
+                   "same source is translated again with the same flags"),
+    llvm::cl::value_desc("directory"), llvm::cl::cat(SuperastCPPCategory));
+
+// How the statistics are printed
+enum class StatsFormat { None, Text, Json };
+
+static llvm::cl::opt<StatsFormat> Stats("stats",
+    llvm::cl::desc("Print the time of each phase, the translated nodes and the "
+                   "memory used, to stderr"),
+    llvm::cl::ValueOptional,
+    llvm::cl::values(
+        clEnumValN(StatsFormat::Text, "", "As text"),
+        clEnumValN(StatsFormat::Text, "text", "As text"),
+        clEnumValN(StatsFormat::Json, "json", "As json")),
+    llvm::cl::init(StatsFormat::None), llvm::cl::cat(SuperastCPPCategory));
+
+static llvm::cl::opt<std::string> StatsFile("stats-file",
+    llvm::cl::desc("Write the statistics of -stats to this file instead"),
+    llvm::cl::value_desc("file"), llvm::cl::cat(SuperastCPPCategory));
+
+// Whether nodes can have the field with the given positions
+static bool writesField(PositionFormat positions, llvm::StringRef name) {
+  if (name == "line") return positions != PositionFormat::Offset;
+  if (name == "column") return positions == PositionFormat::LineColumn;
+  if (name == "offset") return positions == PositionFormat::Offset;
+  return true;
+}
+
+// Applies the list of -fields over the default ones
+static bool parseFields(llvm::StringRef list, PositionFormat positions,
+                        OutputFields& fields) {
+  llvm::SmallVector<llvm::StringRef, 8> names;
+  list.split(names, ',', -1, false);
+  for (llvm::StringRef name : names) {
+    const bool write = !name.startswith("-");
+    if (name.startswith("-") || name.startswith("+")) name = name.drop_front();
+    bool* field = llvm::StringSwitch<bool*>(name)
+        .Case("id", &fields.id)
+        .Case("line", &fields.line)
+        .Case("column", &fields.column)
+        .Case("offset", &fields.offset)
+        .Case("data-type", &fields.dataType)
+        .Default(nullptr);
+    if (!field) {
+      llvm::errs() << "Unknown field in -fields: " << name << "\n";
+      return false;
+    }
+    if (write && !writesField(positions, name)) {
+      llvm::errs() << "Field " << name << " in -fields is not written with "
+                      "this -positions\n";
+      return false;
+    }
+    *field = write;
+  }
+  return true;
+}
+
+static bool readFile(const std::string& path, std::string& contents) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    llvm::errs() << "Could not read " << path << ": "
+                 << buffer.getError().message() << "\n";
+    return false;
+  }
+  contents = (*buffer)->getBuffer().str();
+  return true;
+}
+
+// Reads -previous-source and -previous-output, which go together
+static bool readPrevious(PreviousTranslation& previous) {
+  if (PreviousSource.empty() && PreviousOutput.empty()) return true;
+  if (PreviousSource.empty() || PreviousOutput.empty()) {
+    llvm::errs() << "-previous-source and -previous-output go together\n";
+    return false;
+  }
+  return readFile(PreviousSource, previous.source) &&
+         readFile(PreviousOutput, previous.output);
+}
+
+// Main function
+int main(int argc, const char **argv) {
+  clang::tooling::CommonOptionsParser OptionsParser(argc, argv,
+      SuperastCPPCategory, llvm::cl::ZeroOrMore);
+
+  TranslationOptions options;
+  options.jobs = Jobs;
+  options.ndjson = NDJson;
+  options.format = Format;
+  options.visitor.streamStatements = Stream;
+  options.visitor.skipExternalBodies = SkipExternalBodies;
+  options.visitor.positions = Positions;
+  options.visitor.checkOnly = CheckOnly;
+  if (CheckOnly && Stream) {
+    llvm::errs() << "-check-only has no statements to stream\n";
+    return 1;
+  }
+  if (!parseFields(Fields, Positions, options.visitor.fields)) return 1;
+  std::unique_ptr<PreambleCache> preambleCache;
+  if (!PreambleCacheDir.empty()) {
+    preambleCache.reset(new PreambleCache(PreambleCacheDir));
+    options.preambleCache = preambleCache.get();
+  }
+  std::unique_ptr<ResultCache> resultCache;
+  if (!CacheDir.empty()) {
+    resultCache.reset(new ResultCache(CacheDir));
+    options.resultCache = resultCache.get();
+  }
+
+  // Keep translating requests in the same process
+  if (ServeStdio) {
+    // Each reply is a single compact json document
+    if (Format != OutputFormat::Compact || Stream || NDJson ||
+        Stats != StatsFormat::None || !StatsFile.empty()) {
+      llvm::errs() << "-serve-stdio only replies compact json, without "
+                      "-stream, -ndjson or -stats\n";
+      return 1;
+    }
+    return serveStream(OptionsParser.getCompilations(), options,
+                       std::cin, std::cout);
+  }
+
+  // Statistics are only collected for the files of the command line
+  if ((!BatchManifest.empty() || Stdin || !Bundle.empty()) &&
+      (Stats != StatsFormat::None || !StatsFile.empty())) {
+    llvm::errs() << "-batch, -stdin and -bundle do not collect -stats\n";
+    return 1;
+  }
+
+  // Files and flags of a manifest, each one in an isolated process
+  if (!BatchManifest.empty()) {
+    std::ifstream file;
+    if (BatchManifest != "-") {
+      file.open(BatchManifest);
+      if (!file) {
+        llvm::errs() << "Could not read " << BatchManifest << "\n";
+        return 1;
+      }
+    }
+    std::vector<BatchEntry> entries;
+    std::string error;
+    if (!readManifest(BatchManifest == "-" ? std::cin : file, entries, error)) {
+      llvm::errs() << error << "\n";
+      return 1;
+    }
+    return runBatch(OptionsParser.getCompilations(), entries, options, Jobs,
+                    Timeout, stdout);
+  }
+
+  // Sources in memory, never written to disk
+  if (!Stdin && (!PreviousSource.empty() || !PreviousOutput.empty())) {
+    llvm::errs() << "-previous-source and -previous-output need -stdin\n";
+    return 1;
+  }
+  if (Stdin || !Bundle.empty()) {
+    if (Format != OutputFormat::Compact || Stream) {
+      llvm::errs() << "-stdin and -bundle only print compact json\n";
+      return 1;
+    }
+    const std::string input = Stdin ? "-" : Bundle;
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFileOrSTDIN(input);
+    if (!buffer) {
+      llvm::errs() << "Could not read " << input << ": "
+                   << buffer.getError().message() << "\n";
+      return 1;
+    }
+
+    std::vector<BundleEntry> entries;
+    if (Stdin) {
+      BundleEntry entry;
+      entry.name = StdinName;
+      entry.source = (*buffer)->getBuffer().str();
+      if (!readPrevious(entry.previous)) return 1;
+      entries.push_back(std::move(entry));
+    }
+    else {
+      std::string error;
+      if (!readBundle((*buffer)->getBuffer(), entries, error)) {
+        llvm::errs() << error << "\n";
+        return 1;
+      }
+      options.ndjson = true;
+    }
+    return translateBundle(OptionsParser.getCompilations(), entries, options,
+                           stdout);
+  }
+
+  if (OptionsParser.getSourcePathList().empty()) {
+    llvm::errs() << "No input files\n";
+    return 1;
+  }
+
+  std::unique_ptr<RunStats> stats;
+  if (Stats != StatsFormat::None) {
+    stats.reset(new RunStats());
+    options.stats = stats.get();
+  }
+
+  // Each file is translated on its own, and dumped to stdout in the same
+  // order as the input files
+  const int returnValue = translateFiles(OptionsParser.getCompilations(),
+      OptionsParser.getSourcePathList(), options, stdout);
+
+  if (stats) {
+    if (StatsFile.empty()) {
+      stats->print(llvm::errs(), Stats == StatsFormat::Json);
+    }
+    else {
+      std::error_code error;
+      llvm::raw_fd_ostream file(StatsFile, error, llvm::sys::fs::F_Text);
+      if (error) {
+        llvm::errs() << "Could not write " << StatsFile << ": "
+                     << error.message() << "\n";
+      }
+      else {
+        stats->print(file, Stats == StatsFormat::Json);
+      }
+    }
+  }
+  return returnValue;
+}
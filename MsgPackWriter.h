@@ -0,0 +1,226 @@
+#ifndef CPPTRANSLATE_MSGPACK_WRITER_H
+#define CPPTRANSLATE_MSGPACK_WRITER_H
+
+// RapidJson library for JSON
+#include "rapidjson/rapidjson.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Appends str to out as a MessagePack string, with the shortest header
+inline void appendMsgPackString(std::string& out, const char* str,
+                                uint32_t length) {
+  unsigned lengthBytes;
+  if (length < 32) {
+    out.push_back(static_cast<char>(0xa0 | length)); // fixstr
+    lengthBytes = 0;
+  }
+  else if (length <= UINT8_MAX) {
+    out.push_back(static_cast<char>(0xd9));
+    lengthBytes = 1;
+  }
+  else if (length <= UINT16_MAX) {
+    out.push_back(static_cast<char>(0xda));
+    lengthBytes = 2;
+  }
+  else {
+    out.push_back(static_cast<char>(0xdb));
+    lengthBytes = 4;
+  }
+  for (unsigned i = lengthBytes; i > 0; --i) {
+    out.push_back(static_cast<char>(length >> (8 * (i - 1))));
+  }
+  out.append(str, length);
+}
+
+// Writes MessagePack with the same interface as a rapidjson Writer, so it can
+// be given to Document::Accept or to a JsonHandlerAdapter.
+//
+// The number of members of an object is not known until it ends, so maps and
+// arrays get a header of fixed width (map 32, array 32) that is filled in at
+// the end. A root value is kept in memory until it is finished, and then
+// written to the stream.
+template <typename OutputStream>
+class MsgPackWriter {
+public:
+  explicit MsgPackWriter(OutputStream& os) : os(&os), hasRoot(false) {}
+
+  void Reset(OutputStream& newOs) {
+    os = &newOs;
+    hasRoot = false;
+    levels.clear();
+    buffer.clear();
+  }
+
+  bool IsComplete() const { return hasRoot && levels.empty(); }
+
+  bool Null() {
+    beginValue();
+    put(0xc0);
+    return endValue();
+  }
+
+  bool Bool(bool b) {
+    beginValue();
+    put(b ? 0xc3 : 0xc2);
+    return endValue();
+  }
+
+  bool Int(int i) { return Int64(i); }
+  bool Uint(unsigned u) { return Uint64(u); }
+
+  bool Int64(int64_t i) {
+    if (i >= 0) return Uint64(static_cast<uint64_t>(i));
+    beginValue();
+    if (i >= -32) {
+      put(static_cast<uint8_t>(i)); // negative fixint
+    }
+    else if (i >= INT8_MIN) {
+      put(0xd0);
+      putBigEndian(static_cast<uint8_t>(i), 1);
+    }
+    else if (i >= INT16_MIN) {
+      put(0xd1);
+      putBigEndian(static_cast<uint16_t>(i), 2);
+    }
+    else if (i >= INT32_MIN) {
+      put(0xd2);
+      putBigEndian(static_cast<uint32_t>(i), 4);
+    }
+    else {
+      put(0xd3);
+      putBigEndian(static_cast<uint64_t>(i), 8);
+    }
+    return endValue();
+  }
+
+  bool Uint64(uint64_t u) {
+    beginValue();
+    if (u < 0x80) {
+      put(static_cast<uint8_t>(u)); // positive fixint
+    }
+    else if (u <= UINT8_MAX) {
+      put(0xcc);
+      putBigEndian(u, 1);
+    }
+    else if (u <= UINT16_MAX) {
+      put(0xcd);
+      putBigEndian(u, 2);
+    }
+    else if (u <= UINT32_MAX) {
+      put(0xce);
+      putBigEndian(u, 4);
+    }
+    else {
+      put(0xcf);
+      putBigEndian(u, 8);
+    }
+    return endValue();
+  }
+
+  bool Double(double d) {
+    beginValue();
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    put(0xcb);
+    putBigEndian(bits, 8);
+    return endValue();
+  }
+
+  bool String(const char* str, rapidjson::SizeType length, bool copy = false) {
+    (void)copy;
+    beginValue();
+    appendMsgPackString(buffer, str, length);
+    return endValue();
+  }
+
+  bool String(const char* str) {
+    return String(str, static_cast<rapidjson::SizeType>(std::strlen(str)));
+  }
+
+  bool StartObject() { return startComposite(0xdf); }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool copy = false) {
+    return String(str, length, copy);
+  }
+
+  bool Key(const char* str) {
+    return String(str, static_cast<rapidjson::SizeType>(std::strlen(str)));
+  }
+
+  // Keys are counted as values, so a map has half of them
+  bool EndObject(rapidjson::SizeType memberCount = 0) {
+    (void)memberCount;
+    return endComposite(2);
+  }
+
+  bool StartArray() { return startComposite(0xdd); }
+
+  bool EndArray(rapidjson::SizeType elementCount = 0) {
+    (void)elementCount;
+    return endComposite(1);
+  }
+
+  // Writes an already encoded value
+  bool RawValue(const char* data, size_t length) {
+    beginValue();
+    buffer.append(data, length);
+    return endValue();
+  }
+
+private:
+  struct Level {
+    size_t header;   // Offset of the header in buffer
+    uint32_t count;  // Values written inside, keys included
+  };
+
+  void put(uint8_t byte) { buffer.push_back(static_cast<char>(byte)); }
+
+  void putBigEndian(uint64_t value, unsigned bytes) {
+    for (unsigned i = bytes; i > 0; --i) put(value >> (8 * (i - 1)));
+  }
+
+  void beginValue() {
+    if (levels.empty()) hasRoot = true;
+    else ++levels.back().count;
+  }
+
+  // A finished root value is written to the stream
+  bool endValue() {
+    if (!levels.empty()) return true;
+    for (char c : buffer) os->Put(c);
+    buffer.clear();
+    return true;
+  }
+
+  bool startComposite(uint8_t marker) {
+    beginValue();
+    Level level;
+    level.header = buffer.size();
+    level.count = 0;
+    levels.push_back(level);
+    put(marker);
+    putBigEndian(0, 4);
+    return true;
+  }
+
+  bool endComposite(unsigned valuesPerEntry) {
+    const Level level = levels.back();
+    levels.pop_back();
+    const uint32_t entries = level.count / valuesPerEntry;
+    for (unsigned i = 0; i < 4; ++i) {
+      buffer[level.header + 1 + i] =
+          static_cast<char>(entries >> (8 * (3 - i)));
+    }
+    return endValue();
+  }
+
+  OutputStream* os;
+  bool hasRoot;
+  std::vector<Level> levels;
+  std::string buffer; // Encoding of the unfinished root value
+};
+
+#endif // CPPTRANSLATE_MSGPACK_WRITER_H
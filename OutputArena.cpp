@@ -0,0 +1,26 @@
+#include "./OutputArena.h"
+
+#include <algorithm>
+
+const size_t OutputArena::MAX_KEPT;
+
+OutputArena::OutputArena(size_t reserve)
+    : reserve(std::min(reserve, MAX_KEPT)) {
+}
+
+rapidjson::StringBuffer& OutputArena::begin() {
+  buffer.Clear();
+  if (reserve > 0) {
+    // Growing the empty buffer allocates exactly what is pushed
+    buffer.Push(reserve);
+    buffer.Clear();
+    reserve = 0;
+  }
+  return buffer;
+}
+
+void OutputArena::end() {
+  const size_t size = buffer.GetSize();
+  buffer.Clear();
+  if (size > MAX_KEPT) buffer = rapidjson::StringBuffer();
+}
@@ -0,0 +1,30 @@
+#ifndef CPPTRANSLATE_OUTPUT_ARENA_H
+#define CPPTRANSLATE_OUTPUT_ARENA_H
+
+#include "rapidjson/stringbuffer.h"
+
+#include <cstddef>
+
+// Buffer where one translation at a time is written. Its memory is kept for
+// the next translation, so a run over similar files stops allocating output
+// after the first ones. The memory of outputs larger than MAX_KEPT is
+// released once they are done.
+class OutputArena {
+public:
+  static const size_t MAX_KEPT = 64 * 1024 * 1024;
+
+  // reserve is allocated before the first translation, usually the largest
+  // output seen by another arena
+  explicit OutputArena(size_t reserve = 0);
+
+  // Empty buffer for the next translation
+  rapidjson::StringBuffer& begin();
+  // Called once the output of the buffer is no longer needed
+  void end();
+
+private:
+  rapidjson::StringBuffer buffer;
+  size_t reserve;
+};
+
+#endif // CPPTRANSLATE_OUTPUT_ARENA_H
@@ -0,0 +1,104 @@
+#include "./PreambleCache.h"
+#include "./FileUtils.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+PreambleCache::PreambleCache(const std::string& directory) {
+  // The pch refers to its header by path, so it must not depend on the cwd
+  llvm::SmallString<128> absolutePath(directory);
+  llvm::sys::fs::make_absolute(absolutePath);
+  llvm::sys::fs::create_directories(absolutePath);
+  this->directory = std::string(absolutePath.str());
+}
+
+std::string PreambleCache::getPreamble(llvm::StringRef source) {
+  std::string preamble;
+  while (!source.empty()) {
+    std::pair<llvm::StringRef, llvm::StringRef> split = source.split('\n');
+    const llvm::StringRef line = split.first.trim();
+    source = split.second;
+
+    if (line.empty() || line.startswith("//")) continue;
+    // Only system includes. Anything else could change how the following
+    // headers are parsed, or depend on the directory of the source.
+    if (!line.startswith("#")) break;
+    const llvm::StringRef directive = line.drop_front().ltrim();
+    if (!directive.startswith("include") ||
+        !directive.drop_front(7).ltrim().startswith("<")) {
+      break;
+    }
+    preamble += line;
+    preamble += '\n';
+  }
+  return preamble;
+}
+
+std::string PreambleCache::getPCH(llvm::StringRef source,
+                                  const std::vector<std::string>& flags) {
+  const std::string preamble = getPreamble(source);
+  if (preamble.empty()) return "";
+
+  std::vector<std::string> keyParts = {clang::getClangFullVersion(), preamble};
+  keyParts.insert(keyParts.end(), flags.begin(), flags.end());
+  const std::string key = hashKey(keyParts);
+
+  llvm::SmallString<128> headerPath(directory);
+  llvm::sys::path::append(headerPath, key + ".h");
+  llvm::SmallString<128> pchPath(directory);
+  llvm::sys::path::append(pchPath, key + ".pch");
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (failedKeys.count(key)) return "";
+  if (!llvm::sys::fs::exists(pchPath) &&
+      !buildPCH(preamble, flags, std::string(headerPath.str()),
+                std::string(pchPath.str()))) {
+    // Do not try again in this process
+    failedKeys.insert(key);
+    return "";
+  }
+  return std::string(pchPath.str());
+}
+
+bool PreambleCache::buildPCH(const std::string& preamble,
+                             const std::vector<std::string>& flags,
+                             const std::string& headerPath,
+                             const std::string& pchPath) {
+  // The pch keeps the path and the time of its header, which must stay there
+  // unchanged for the pchs other processes built from it
+  if (!writeFileIfAbsent(headerPath, preamble)) return false;
+
+  // Built under a name of its own, so a pch is only ever replaced whole
+  llvm::SmallString<128> tempPath;
+  if (llvm::sys::fs::createUniqueFile(pchPath + "-%%%%%%%%.tmp", tempPath)) {
+    return false;
+  }
+
+  std::vector<std::string> commandLine = {"clang-tool"};
+  for (const std::string& flag : flags) {
+    if (flag != "-fsyntax-only") commandLine.push_back(flag);
+  }
+  commandLine =
+      clang::tooling::getClangStripOutputAdjuster()(commandLine, headerPath);
+  commandLine.insert(commandLine.end(), {"-x", "c++-header", headerPath,
+                                         "-o", std::string(tempPath.str())});
+
+  clang::FileManager files((clang::FileSystemOptions()));
+  clang::tooling::ToolInvocation invocation(commandLine,
+                                            new clang::GeneratePCHAction, &files);
+  if (!invocation.run() || llvm::sys::fs::rename(tempPath, pchPath)) {
+    llvm::sys::fs::remove(tempPath);
+    return false;
+  }
+  return true;
+}
+
+void PreambleCache::invalidate(const std::string& pchPath) {
+  std::lock_guard<std::mutex> lock(mutex);
+  llvm::sys::fs::remove(pchPath);
+}
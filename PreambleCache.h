@@ -0,0 +1,42 @@
+#ifndef CPPTRANSLATE_PREAMBLE_CACHE_H
+#define CPPTRANSLATE_PREAMBLE_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Keeps a directory of precompiled headers, one for each distinct preamble
+// (the #include lines at the start of a source) and set of flags. A source
+// can then be parsed with -include-pch, and its own #include lines are skipped
+// by their include guards.
+class PreambleCache {
+public:
+  explicit PreambleCache(const std::string& directory);
+
+  // Returns the pch to parse source with the given flags, building it if it is
+  // not in the cache yet. Empty if the source has no preamble or the pch could
+  // not be built.
+  std::string getPCH(llvm::StringRef source,
+                     const std::vector<std::string>& flags);
+
+  // Removes a pch that clang rejected, as when its header or the headers it
+  // includes changed since it was built, so the next getPCH builds it again
+  void invalidate(const std::string& pchPath);
+
+  // The #include lines before the first line with code
+  static std::string getPreamble(llvm::StringRef source);
+
+private:
+  bool buildPCH(const std::string& preamble,
+                const std::vector<std::string>& flags,
+                const std::string& headerPath, const std::string& pchPath);
+
+  std::string directory;
+  std::mutex mutex; // Only one build at a time, others wait for it
+  std::set<std::string> failedKeys;
+};
+
+#endif // CPPTRANSLATE_PREAMBLE_CACHE_H
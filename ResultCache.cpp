@@ -0,0 +1,66 @@
+#include "./ResultCache.h"
+#include "./FileUtils.h"
+
+#include "clang/Basic/Version.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+// Change it whenever the translation of the same source changes, so the
+// results of older versions are not used anymore
+static const char* const OUTPUT_VERSION = "4";
+
+ResultCache::ResultCache(const std::string& directory)
+    : directory(directory) {
+}
+
+// If there is an #include "...", the result also depends on that file
+static bool hasLocalIncludes(llvm::StringRef source) {
+  while (!source.empty()) {
+    std::pair<llvm::StringRef, llvm::StringRef> split = source.split('\n');
+    const llvm::StringRef line = split.first.ltrim();
+    source = split.second;
+    if (!line.startswith("#")) continue;
+    const llvm::StringRef directive = line.drop_front().ltrim();
+    if (directive.startswith("include") &&
+        directive.drop_front(7).ltrim().startswith("\"")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string ResultCache::getKey(llvm::StringRef source,
+                                const std::vector<std::string>& flags,
+                                llvm::StringRef outputConfig) const {
+  if (hasLocalIncludes(source)) return "";
+
+  std::vector<std::string> keyParts = {
+      OUTPUT_VERSION, clang::getClangFullVersion(), outputConfig.str()};
+  keyParts.insert(keyParts.end(), flags.begin(), flags.end());
+  keyParts.push_back(source.str());
+  return hashKey(keyParts);
+}
+
+std::string ResultCache::getPath(const std::string& key) const {
+  // Spread the entries in subdirectories, by the first byte of the key
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, key.substr(0, 2), key + ".json");
+  return std::string(path.str());
+}
+
+bool ResultCache::lookup(const std::string& key, std::string& output) const {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(getPath(key));
+  if (!buffer) return false;
+  output = (*buffer)->getBuffer().str();
+  return true;
+}
+
+void ResultCache::store(const std::string& key, llvm::StringRef output) const {
+  const std::string path = getPath(key);
+  llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path));
+  // Nothing to do if it fails, next time it will be translated again
+  writeFileAtomically(path, output);
+}
@@ -0,0 +1,31 @@
+#ifndef CPPTRANSLATE_RESULT_CACHE_H
+#define CPPTRANSLATE_RESULT_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+// On-disk cache of translations, keyed by the contents of the source. Entries
+// are written atomically, so many processes can share the same directory.
+class ResultCache {
+public:
+  explicit ResultCache(const std::string& directory);
+
+  // Key of the translation of source with the given flags. outputConfig must
+  // describe every option that changes the output. Empty if the result can not
+  // be cached: sources with quoted includes depend on other files.
+  std::string getKey(llvm::StringRef source,
+                     const std::vector<std::string>& flags,
+                     llvm::StringRef outputConfig) const;
+
+  bool lookup(const std::string& key, std::string& output) const;
+  void store(const std::string& key, llvm::StringRef output) const;
+
+private:
+  std::string getPath(const std::string& key) const;
+
+  std::string directory;
+};
+
+#endif // CPPTRANSLATE_RESULT_CACHE_H
@@ -0,0 +1,91 @@
+#include "./Server.h"
+#include "./Bundle.h"
+#include "./Translator.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+// Largest request read. The length of a frame is not trusted to allocate it.
+static const unsigned long long MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+enum class FrameStatus { Valid, InvalidHeader, TooLarge };
+
+// Reads a "<length>\n<payload>" frame. Returns false at the end of the input
+static bool readFrame(std::istream& in, std::string& payload,
+                      FrameStatus& status) {
+  std::string header;
+  if (!std::getline(in, header)) return false;
+
+  char* end = nullptr;
+  const unsigned long long length = std::strtoull(header.c_str(), &end, 10);
+  if (header.empty() || *end != '\0') {
+    status = FrameStatus::InvalidHeader;
+    return true;
+  }
+  // Skipped, so the frames after it can still be read
+  if (length > MAX_FRAME_SIZE) {
+    status = FrameStatus::TooLarge;
+    const unsigned long long maxSkip =
+        std::numeric_limits<std::streamsize>::max();
+    in.ignore(static_cast<std::streamsize>(std::min(length, maxSkip)));
+    return true;
+  }
+
+  status = FrameStatus::Valid;
+  payload.resize(length);
+  if (length > 0 && !in.read(&payload[0], length)) return false;
+  return true;
+}
+
+static void writeFrame(std::ostream& out, const std::string& payload) {
+  out << payload.size() << '\n' << payload;
+  out.flush();
+}
+
+static std::string errorReply(const std::string& message) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("error");
+  writer.String(message.c_str(), message.size());
+  writer.EndObject();
+  return buffer.GetString();
+}
+
+int serveStream(const clang::tooling::CompilationDatabase& compilations,
+                const TranslationOptions& options,
+                std::istream& in, std::ostream& out) {
+  SourceTranslator translator(compilations, options);
+
+  std::string payload;
+  FrameStatus status;
+  while (readFrame(in, payload, status)) {
+    if (status == FrameStatus::InvalidHeader) {
+      // Lost the framing, nothing else can be read
+      writeFrame(out, errorReply("Invalid frame header"));
+      return 1;
+    }
+    if (status == FrameStatus::TooLarge) {
+      writeFrame(out, errorReply("Request larger than " +
+                                 std::to_string(MAX_FRAME_SIZE) + " bytes"));
+      continue;
+    }
+
+    BundleEntry request;
+    if (!parseBundleEntry(payload, request)) {
+      writeFrame(out, errorReply("Request must be an object with a \"source\""));
+      continue;
+    }
+
+    std::string reply;
+    translator.translateToString(
+        request.name, request.source, request.flags, reply,
+        request.previous.output.empty() ? nullptr : &request.previous);
+    reply.pop_back(); // The frame already delimits the reply
+    writeFrame(out, reply);
+  }
+  return 0;
+}
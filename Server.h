@@ -0,0 +1,22 @@
+#ifndef CPPTRANSLATE_SERVER_H
+#define CPPTRANSLATE_SERVER_H
+
+#include "./Translator.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include <iostream>
+
+// Translates requests read from `in` until the end of the input, replying to
+// `out`. Requests and replies are framed as "<length>\n<payload>".
+//
+// Each request is a json object:
+//   {"source": "int main() {}", "name": "input.cpp", "flags": ["-DN=4"]}
+// where only "source" is required. "previous-source" and "previous-output",
+// the last request and its reply, let the unchanged statements be copied
+// with their ids. The reply is the translated json, or
+// {"error": "..."} if the request could not be read or is larger than 64 MiB.
+int serveStream(const clang::tooling::CompilationDatabase& compilations,
+                const TranslationOptions& options,
+                std::istream& in, std::ostream& out);
+
+#endif // CPPTRANSLATE_SERVER_H
@@ -0,0 +1,58 @@
+#include "./SourcePositions.h"
+
+#include <algorithm>
+
+SourcePositions::SourcePositions(const clang::SourceManager& sourceManager)
+    : sourceManager(sourceManager), loaded(false), cursor(0) {
+}
+
+void SourcePositions::loadMainFile() {
+  loaded = true;
+  mainFile = sourceManager.getMainFileID();
+  if (mainFile.isInvalid()) return;
+  bool invalid = false;
+  const llvm::StringRef buffer = sourceManager.getBufferData(mainFile, &invalid);
+  if (invalid) return;
+
+  // Lines end as clang counts them: \n, \r\n or a lone \r
+  lineStarts.push_back(0);
+  for (unsigned i = 0; i < buffer.size(); ++i) {
+    if (buffer[i] == '\r' && i + 1 < buffer.size() && buffer[i + 1] == '\n') ++i;
+    if (buffer[i] == '\n' || buffer[i] == '\r') lineStarts.push_back(i + 1);
+  }
+}
+
+bool SourcePositions::isOnLine(unsigned line, unsigned offset) const {
+  return line < lineStarts.size() && lineStarts[line] <= offset &&
+         (line + 1 == lineStarts.size() || offset < lineStarts[line + 1]);
+}
+
+SourcePositions::Position SourcePositions::get(clang::SourceLocation loc) {
+  Position position = {-1, -1, -1};
+  if (loc.isInvalid()) return position;
+  if (!loaded) loadMainFile();
+
+  const std::pair<clang::FileID, unsigned> decomposed =
+      sourceManager.getDecomposedLoc(sourceManager.getSpellingLoc(loc));
+  const unsigned offset = decomposed.second;
+  position.offset = offset;
+
+  // Spelled out of the main file, as in a macro of a header
+  if (decomposed.first != mainFile || lineStarts.empty()) {
+    position.line = sourceManager.getLineNumber(decomposed.first, offset);
+    position.column = sourceManager.getColumnNumber(decomposed.first, offset);
+    return position;
+  }
+
+  // The same line or the next one, else search for it
+  if (!isOnLine(cursor, offset)) {
+    if (isOnLine(cursor + 1, offset)) ++cursor;
+    else {
+      cursor = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) -
+               lineStarts.begin() - 1;
+    }
+  }
+  position.line = cursor + 1;
+  position.column = offset - lineStarts[cursor] + 1;
+  return position;
+}
@@ -0,0 +1,38 @@
+#ifndef CPPTRANSLATE_SOURCE_POSITIONS_H
+#define CPPTRANSLATE_SOURCE_POSITIONS_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+
+#include <vector>
+
+// Decodes the position of each translated node once. The nodes of the main
+// file come mostly in increasing order, so their line is found by moving a
+// cursor from the line of the previous node.
+class SourcePositions {
+public:
+  // -1 if unknown. Line and column start at 1, the byte offset at 0.
+  struct Position {
+    int line;
+    int column;
+    int offset;
+  };
+
+  explicit SourcePositions(const clang::SourceManager& sourceManager);
+
+  // Position where loc is spelled
+  Position get(clang::SourceLocation loc);
+
+private:
+  // The main file is only known once the parsing has begun
+  void loadMainFile();
+  bool isOnLine(unsigned line, unsigned offset) const;
+
+  const clang::SourceManager& sourceManager;
+  bool loaded;
+  clang::FileID mainFile;
+  std::vector<unsigned> lineStarts; // Offset of each line of the main file
+  unsigned cursor;                  // Index of the line found last
+};
+
+#endif // CPPTRANSLATE_SOURCE_POSITIONS_H
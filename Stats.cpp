@@ -0,0 +1,107 @@
+#include "./Stats.h"
+
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "llvm/Support/Format.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+
+RunStats::RunStats() : start(TimePoint::now()), files(0) {
+}
+
+void RunStats::add(const FileStats& file) {
+  std::lock_guard<std::mutex> lock(mutex);
+  ++files;
+  total.parse.wallSeconds += file.parse.wallSeconds;
+  total.parse.cpuSeconds += file.parse.cpuSeconds;
+  total.translate.wallSeconds += file.translate.wallSeconds;
+  total.translate.cpuSeconds += file.translate.cpuSeconds;
+  for (const auto& node : file.nodes) total.nodes[node.first] += node.second;
+  total.ids += file.ids;
+  total.outputBytes += file.outputBytes;
+  total.bufferedBytes = std::max(total.bufferedBytes, file.bufferedBytes);
+}
+
+void RunStats::addOutput(uint64_t bytes, uint64_t bufferedBytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  total.outputBytes += bytes;
+  total.bufferedBytes = std::max(total.bufferedBytes, bufferedBytes);
+}
+
+template <typename Writer>
+static void writePhase(Writer& writer, const char* name,
+                       const PhaseTime& phase) {
+  writer.Key(name);
+  writer.StartObject();
+  writer.Key("wall-seconds");
+  writer.Double(phase.wallSeconds);
+  writer.Key("cpu-seconds");
+  writer.Double(phase.cpuSeconds);
+  writer.EndObject();
+}
+
+static void printPhase(llvm::raw_ostream& out, const char* name,
+                       const PhaseTime& phase) {
+  out << llvm::format("  %-16s wall %.3fs  cpu %.3fs\n", name,
+                      phase.wallSeconds, phase.cpuSeconds);
+}
+
+void RunStats::print(llvm::raw_ostream& out, bool json) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const double wallSeconds = TimePoint::now().wall - start.wall;
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  if (json) {
+    rapidjson::StringBuffer buffer;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.Key("files");
+    writer.Uint(files);
+    writer.Key("wall-seconds");
+    writer.Double(wallSeconds);
+    writer.Key("phases");
+    writer.StartObject();
+    writePhase(writer, "parse", total.parse);
+    writePhase(writer, "translate", total.translate);
+    writer.EndObject();
+    writer.Key("nodes");
+    writer.StartObject();
+    for (const auto& node : total.nodes) {
+      writer.Key(node.first.c_str(), node.first.size());
+      writer.Uint64(node.second);
+    }
+    writer.EndObject();
+    writer.Key("ids");
+    writer.Uint64(total.ids);
+    writer.Key("output-bytes");
+    writer.Uint64(total.outputBytes);
+    writer.Key("buffered-bytes");
+    writer.Uint64(total.bufferedBytes);
+    writer.Key("peak-rss-kb");
+    writer.Int64(usage.ru_maxrss);
+    writer.EndObject();
+    out << buffer.GetString() << "\n";
+    return;
+  }
+
+  out << "cpptranslate statistics\n";
+  out << llvm::format("  files            %u\n", files);
+  out << llvm::format("  wall             %.3fs\n", wallSeconds);
+  printPhase(out, "parse", total.parse);
+  printPhase(out, "translate", total.translate);
+  out << llvm::format("  ids              %llu\n",
+                      (unsigned long long)total.ids);
+  out << llvm::format("  output bytes     %llu\n",
+                      (unsigned long long)total.outputBytes);
+  out << llvm::format("  buffered bytes   %llu\n",
+                      (unsigned long long)total.bufferedBytes);
+  out << llvm::format("  peak RSS         %ld KB\n", usage.ru_maxrss);
+  out << "  translated nodes\n";
+  for (const auto& node : total.nodes) {
+    out << llvm::format("    %-30s %llu\n", node.first.c_str(),
+                        (unsigned long long)node.second);
+  }
+}
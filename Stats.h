@@ -0,0 +1,74 @@
+#ifndef CPPTRANSLATE_STATS_H
+#define CPPTRANSLATE_STATS_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <time.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Wall time, and CPU time of the calling thread, in seconds
+struct TimePoint {
+  static TimePoint now() {
+    TimePoint point;
+    point.wall = std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    point.cpu = cpu.tv_sec + cpu.tv_nsec / 1e9;
+    return point;
+  }
+
+  double wall;
+  double cpu;
+};
+
+// Time spent in a phase, added over all the files
+struct PhaseTime {
+  PhaseTime() : wallSeconds(0), cpuSeconds(0) {}
+
+  void add(const TimePoint& start, const TimePoint& end) {
+    wallSeconds += end.wall - start.wall;
+    cpuSeconds += end.cpu - start.cpu;
+  }
+
+  double wallSeconds;
+  double cpuSeconds;
+};
+
+// Statistics of the translation of a file. Only collected with -stats, all
+// the counters are added, so a file can take several translations.
+struct FileStats {
+  FileStats() : ids(0), outputBytes(0), bufferedBytes(0) {}
+
+  PhaseTime parse;     // Clang, until the AST is complete
+  PhaseTime translate; // Traversal of SuperastCPP, writing the output
+  std::map<std::string, uint64_t> nodes; // Translated nodes by clang class
+  uint64_t ids;           // Ids given to the nodes
+  uint64_t outputBytes;   // Only added by RunStats::addOutput
+  uint64_t bufferedBytes; // Largest output kept in memory
+};
+
+// Statistics of a run. Files can be added from many threads.
+class RunStats {
+public:
+  RunStats();
+
+  void add(const FileStats& file);
+  // Bytes written to the output, and the ones kept in memory to write them
+  void addOutput(uint64_t bytes, uint64_t bufferedBytes);
+  // Prints everything, as text or as json
+  void print(llvm::raw_ostream& out, bool json);
+
+private:
+  std::mutex mutex;
+  TimePoint start;
+  unsigned files;
+  FileStats total;
+};
+
+#endif // CPPTRANSLATE_STATS_H
@@ -1,32 +1,40 @@
 #include "./SuperastCPP.h"
-#include "rapidjson/prettywriter.h"
-#include "rapidjson/stringbuffer.h"
+#include "./SuperastCheck.h"
 
-#include <map>
 #include <cassert>
 #include <iostream>
 #include <ostream>
 #include <fstream>
 
-// Our document
-rapidjson::Document document;
-rapidjson::Document::AllocatorType& allocator = document.GetAllocator();
+// OPERATOR TRANSLATIONS, the clang spelling unless it is renamed
+constexpr const char* unaryOpName(clang::UnaryOperatorKind op,
+                                  const char* spelling) {
+  return op == clang::UO_LNot ? "not" :
+         op == clang::UO_Minus ? "neg" :
+         op == clang::UO_Plus ? "pos" :
+         op == clang::UO_PreInc ? "++_" :
+         op == clang::UO_PreDec ? "--_" :
+         op == clang::UO_PostInc ? "_++" :
+         op == clang::UO_PostDec ? "_--" :
+         spelling;
+}
 
-// MAP TRANSLATIONS
-const std::map<std::string,std::string> UNARY_OP_MAPPING {
-    {"!", "not"},
-    {"-", "neg"},
-    {"+", "pos"},
-};
+constexpr const char* binaryOpName(clang::BinaryOperatorKind op,
+                                   const char* spelling) {
+  return op == clang::BO_LOr ? "or" :
+         op == clang::BO_LAnd ? "and" :
+         spelling;
+}
 
-const std::map<std::string,std::string> BINARY_OP_MAPPING {
-    {"||", "or"},
-    {"&&", "and"},
+// Indexed by opcode, for every operator this clang knows
+const char* const UNARY_OP_NAMES[] = {
+#define UNARY_OPERATION(Name, Spelling) unaryOpName(clang::UO_##Name, Spelling),
+#include "clang/AST/OperationKinds.def"
 };
 
-const std::map<std::string,std::string> VECTOR_TYPE_MAPPING {
-    {"float", "double"},
-    {"char", "string"},
+const char* const BINARY_OP_NAMES[] = {
+#define BINARY_OPERATION(Name, Spelling) binaryOpName(clang::BO_##Name, Spelling),
+#include "clang/AST/OperationKinds.def"
 };
 
 // MACRO FOR TRAVERSING
@@ -36,25 +44,27 @@ do {                                                                           \
     return false;                                                              \
 } while (0)
 
-// Custom category for command-line option
-static llvm::cl::OptionCategory SuperastCPPCategory("cpptranslate options");
-
 // Output configuration
-const std::string PRINT_NAME = "operator<<";
-const std::string READ_NAME = "operator>>";
-const std::string VECTOR_POS_NAME = "operator[]";
-const std::string PRINT_FLAG_TYPE = "basic_ostream<char, struct std::char_traits"
-    "<char> > &(basic_ostream<char, struct std::char_traits<char> > &)";
-const std::string PRINT_TYPE = "ostream";
-const std::string READ_TYPE = "istream";
-const std::string VECTOR_TYPE = "class std::vector<";
-const std::string STRING_TYPE = "class std::basic_string<char>";
+// Declarations of namespace std left out of the output
+const char* const IO_OBJECT_NAMES[] = {"cout", "cin", "cerr", "clog"};
+const char* const IO_MANIPULATOR_NAMES[] = {"endl", "ends", "flush"};
 
 // CONSTRUCTOR
-SuperastCPP::SuperastCPP(clang::ASTContext *context)
-    : context(context), 
+SuperastCPP::SuperastCPP(clang::ASTContext *context, JsonHandler& handler,
+                         const SuperastCPPOptions& options)
+    : context(context),
+      out(handler),
+      streamStatements(options.streamStatements),
+      stats(options.stats),
+      reuse(options.reuse),
+      fields(options.fields),
+      writeLine(fields.line && options.positions != PositionFormat::Offset),
+      writeColumn(fields.column &&
+                  options.positions == PositionFormat::LineColumn),
+      writeOffset(fields.offset && options.positions == PositionFormat::Offset),
+      positions(context->getSourceManager()),
+      endlDecl(nullptr),
       currentId(0),
-      sonValue(),
       iofunctionStarted(false) {
 }
 
@@ -62,144 +72,183 @@ SuperastCPP::SuperastCPP(clang::ASTContext *context)
  * STATEMENTS
  ******************/
 bool SuperastCPP::TraverseStmt(clang::Stmt* S) {
-  // If null, or not in main file, skip.
-  if (!S || !context->getSourceManager().isInMainFile(S->getLocStart())) {
-    return true;
-  }
+  if (!enterStmt(S)) return true;
   // Default call. Will call all other Traverses.
   return RecursiveASTVisitor::TraverseStmt(S);
 }
 
+bool SuperastCPP::enterStmt(clang::Stmt* S) {
+  // If null, or not in main file, skip.
+  if (!isTranslated(S)) return false;
+  if (stats) ++stats->nodes[S->getStmtClassName()];
+  return true;
+}
 
-  // IF STATEMENT 
-bool SuperastCPP::TraverseIfStmt(clang::IfStmt* ifs) {
-  rapidjson::Value ifValue(rapidjson::kObjectType);
-  addId(ifValue);
-  addPos(ifValue, ifs);
-  ifValue.AddMember("type", "conditional", allocator);
-
-  // Check if the condition contains a var declaration
-  if (ifs->getConditionVariable()) {
-    ifValue.AddMember("condition", createMessageValue(ifs->getConditionVariable(), "error",
-        "condition-variable",
-        "Variable declarations are not allowed in if conditions"),
-        allocator);
+bool SuperastCPP::isTranslated(clang::Stmt* S) {
+  return S && context->getSourceManager().isInMainFile(S->getLocStart());
+}
+
+// Parentheses and implicit casts are translated as their only child
+static clang::Stmt* getWrappedStmt(clang::Stmt* stmt) {
+  if (auto paren = llvm::dyn_cast<clang::ParenExpr>(stmt)) {
+    return paren->getSubExpr();
   }
-  else {
-    // condition part
-    TRY_TO(TraverseStmt(ifs->getCond()));
+  if (auto cast = llvm::dyn_cast<clang::ImplicitCastExpr>(stmt)) {
+    return cast->getSubExpr();
+  }
+  return nullptr;
+}
 
-    rapidjson::Value conditionValue;
-    conditionValue = sonValue;
-    ifValue.AddMember("condition", conditionValue, allocator);
+clang::Stmt* SuperastCPP::unwrapStmt(clang::Stmt* stmt) {
+  while (isTranslated(stmt)) {
+    clang::Stmt* wrapped = getWrappedStmt(stmt);
+    if (!wrapped) return stmt;
+    stmt = wrapped;
   }
+  return nullptr;
+}
+
+void SuperastCPP::enterWrapped(clang::Stmt* stmt, clang::Stmt* target) {
+  for (; stmt != target; stmt = getWrappedStmt(stmt)) enterStmt(stmt);
+  enterStmt(target);
+}
 
-  // then part
-  TRY_TO(TraverseStmt(ifs->getThen()));
-  // Now sonValue contains the arrayValue
-  ensureSonIsArray();
-  rapidjson::Value blockValue = createBlockValue(sonValue);
-  ifValue.AddMember("then", blockValue, allocator);
-
-  // if has else, print
-  if (ifs->getElse()) {
-    TRY_TO(TraverseStmt(ifs->getElse()));
-    // sonValue contains the arrayValue
-    ensureSonIsArray();
-    blockValue = createBlockValue(sonValue);
-    ifValue.AddMember("else", blockValue, allocator);
+
+  // IF STATEMENT
+bool SuperastCPP::TraverseIfStmt(clang::IfStmt* ifs) {
+  // An else if ladder is translated in this loop, each if in the else block
+  // of the previous one. Those blocks are closed at the end.
+  unsigned elseBlocks = 0;
+  while (true) {
+    out.StartObject();
+    addId();
+    addPos(ifs);
+    out.Key("type");
+    out.String("conditional");
+
+    // Check if the condition contains a var declaration
+    if (ifs->getConditionVariable()) {
+      out.Key("condition");
+      emitMessageValue(ifs->getConditionVariable(), "error",
+          "condition-variable",
+          "Variable declarations are not allowed in if conditions");
+    }
+    else {
+      // condition part
+      TRY_TO(traverseMember("condition", ifs->getCond()));
+    }
+
+    // then part
+    out.Key("then");
+    TRY_TO(traverseBlock(ifs->getThen()));
+
+    // if has else, print
+    clang::Stmt* elseStmt = ifs->getElse();
+    auto elseIf = elseStmt ?
+        llvm::dyn_cast_or_null<clang::IfStmt>(unwrapStmt(elseStmt)) : nullptr;
+    if (elseIf) {
+      out.Key("else");
+      beginBlock();
+      enterWrapped(elseStmt, elseIf);
+      ++elseBlocks;
+      ifs = elseIf;
+      continue;
+    }
+    if (elseStmt) {
+      out.Key("else");
+      TRY_TO(traverseBlock(elseStmt));
+    }
+    out.EndObject();
+    break;
   }
 
-  sonValue = ifValue;
+  for (; elseBlocks > 0; --elseBlocks) {
+    endBlock();
+    out.EndObject();
+  }
   return true;
 }
 
 // RETURN STATEMENT
 bool SuperastCPP::TraverseReturnStmt(clang::ReturnStmt* ret) {
-  rapidjson::Value returnValue(rapidjson::kObjectType);
-  addId(returnValue);
-  addPos(returnValue, ret);
-  
-  TRY_TO(TraverseStmt(ret->getRetValue()));
+  out.StartObject();
+  addId();
+  addPos(ret);
+  out.Key("type");
+  out.String("return");
 
-  returnValue.AddMember("type", "return", allocator);
-  returnValue.AddMember("expression", sonValue, allocator);
+  TRY_TO(traverseMember("expression", ret->getRetValue()));
 
-  sonValue = returnValue;
+  out.EndObject();
   return true;
 }
 
 
 // WHILE STMT
 bool SuperastCPP::TraverseWhileStmt(clang::WhileStmt* whileStmt) {
-
-  rapidjson::Value whileValue(rapidjson::kObjectType);
-  addId(whileValue);
-  addPos(whileValue, whileStmt);
-  whileValue.AddMember("type", "while", allocator);
+  out.StartObject();
+  addId();
+  addPos(whileStmt);
+  out.Key("type");
+  out.String("while");
 
   // Check if the condition of the while contains a var declaration
   if (whileStmt->getConditionVariable()) {
-    whileValue.AddMember("condition", createMessageValue(whileStmt->getConditionVariable(),
-        "error", "condition-variable", 
-        "Variable declarations are not allowed in while conditions"),
-        allocator);
+    out.Key("condition");
+    emitMessageValue(whileStmt->getConditionVariable(),
+        "error", "condition-variable",
+        "Variable declarations are not allowed in while conditions");
   }
   else {
     // Get condition
-    TRY_TO(TraverseStmt(whileStmt->getCond()));
-    whileValue.AddMember("condition", sonValue, allocator);
+    TRY_TO(traverseMember("condition", whileStmt->getCond()));
   }
 
   // Get the body
-  TRY_TO(TraverseStmt(whileStmt->getBody()));
-  // Now sonValue contains the arrayValue
-  ensureSonIsArray();
-  rapidjson::Value blockValue = createBlockValue(sonValue);
-  whileValue.AddMember("block", blockValue, allocator);
+  out.Key("block");
+  TRY_TO(traverseBlock(whileStmt->getBody()));
 
-  sonValue = whileValue;
+  out.EndObject();
   return true;
 }
 
-
-
 // FOR STMT
 bool SuperastCPP::TraverseForStmt(clang::ForStmt* forStmt) {
-  rapidjson::Value forValue(rapidjson::kObjectType);
-  addId(forValue);
-  addPos(forValue, forStmt);
-  forValue.AddMember("type", "for", allocator);
-  
-  // Init
-  TRY_TO(TraverseStmt(forStmt->getInit()));
-  // This could be a compound statement
-  if (sonValue.IsArray()) {
-    sonValue = createMessageValue(forStmt, "error", "compoundStmt", 
+  out.StartObject();
+  addId();
+  addPos(forStmt);
+  out.Key("type");
+  out.String("for");
+
+  // Init. This could be a group of declarations
+  clang::DeclStmt* declStmt =
+      llvm::dyn_cast_or_null<clang::DeclStmt>(forStmt->getInit());
+  if (declStmt && !declStmt->isSingleDecl()) {
+    TRY_TO(traverseDiscarded(declStmt));
+    out.Key("init");
+    emitMessageValue(forStmt, "error", "compoundStmt",
         "Compound Statements are not allowed in for loop init");
   }
-  forValue.AddMember("init", sonValue, allocator);
+  else {
+    TRY_TO(traverseMember("init", forStmt->getInit()));
+  }
 
   // Cond
-  TRY_TO(TraverseStmt(forStmt->getCond()));
-  forValue.AddMember("condition", sonValue, allocator);
+  TRY_TO(traverseMember("condition", forStmt->getCond()));
 
   // Post
-  TRY_TO(TraverseStmt(forStmt->getInc()));
-  forValue.AddMember("post", sonValue, allocator);
+  TRY_TO(traverseMember("post", forStmt->getInc()));
 
   // Get the body
-  TRY_TO(TraverseStmt(forStmt->getBody()));
-  ensureSonIsArray();
-  rapidjson::Value blockValue = createBlockValue(sonValue);
-  forValue.AddMember("block", blockValue, allocator);
+  out.Key("block");
+  TRY_TO(traverseBlock(forStmt->getBody()));
 
-  sonValue = forValue;
+  out.EndObject();
   return true;
 }
 
 bool SuperastCPP::TraverseDoStmt(clang::DoStmt* doStmt) {
-  sonValue = createMessageValue(doStmt, "error", "do/while statement",
+  emitMessageValue(doStmt, "error", "do/while statement",
       "Do/While statements are not allowed");
   return true;
 }
@@ -218,80 +267,86 @@ bool SuperastCPP::TraverseExpr(clang::Expr* expr) {
 
 // COMPOUND STATEMENTS, A block of statements in clangAST
 bool SuperastCPP::TraverseCompoundStmt(clang::CompoundStmt* compoundStmt) {
-  rapidjson::Value arrayValue(rapidjson::kArrayType);
+  // Inside another block, the statements are added to its array
+  const bool flatten = out.inElements();
+  if (flatten) out.markFlattened();
+  else out.StartArray();
+
   // Traverse each statement and append it to the array
   for (clang::Stmt* stmt : compoundStmt->body()) {
-    TRY_TO(TraverseStmt(stmt));
-    if (sonValue.IsArray()) {
-      addElemsToArray(arrayValue, sonValue);
-    }
-    else {
-      arrayValue.PushBack(sonValue, allocator);
-    }
+    TRY_TO(traverseElements(stmt, true));
   }
-  sonValue = arrayValue;
+
+  if (!flatten) out.EndArray();
   return true;
 }
 
 // UNARY OPERATOR
 bool SuperastCPP::TraverseUnaryOperator(clang::UnaryOperator* uop) {
+  out.StartObject();
+  out.Key("type");
+  out.String(UNARY_OP_NAMES[uop->getOpcode()]);
 
-  std::string opString = uop->getOpcodeStr(uop->getOpcode());
-  auto it = UNARY_OP_MAPPING.find(opString);
-  if (it != UNARY_OP_MAPPING.end()) opString = it->second;
+  TRY_TO(traverseMember("expression", uop->getSubExpr()));
 
-  if (opString == "++" || opString == "--") {
-    if (uop->isPrefix(uop->getOpcode())) opString += "_";
-    else opString = "_" + opString;
-  }
-
-  TRY_TO(TraverseStmt(uop->getSubExpr()));
-
-  rapidjson::Value unaryOpValue(rapidjson::kObjectType);
-  addId(unaryOpValue);
-  addPos(unaryOpValue, uop);
-
-  unaryOpValue.AddMember("type",
-                         rapidjson::Value().SetString(opString.c_str(),
-                                                      opString.size(),
-                                                      allocator),
-                         allocator);
-  unaryOpValue.AddMember("expression", sonValue, allocator);
-
-  sonValue = unaryOpValue;
+  // The operand was translated first, and has the lower ids
+  addId();
+  addPos(uop);
+  out.EndObject();
   return true;
 }
 
 
 // BINARY OPERATOR
 bool SuperastCPP::TraverseBinaryOperator(clang::BinaryOperator* bop) {
-  // Save current status
-  std::string opString = bop->getOpcodeStr();
-  auto it = BINARY_OP_MAPPING.find(opString);
-  if (it != BINARY_OP_MAPPING.end()) opString = it->second;
-
   // Comma operator, give a WARNING
-  if (opString == ",") {
-    sonValue = createMessageValue(bop, "warning", "comma operator",
+  if (bop->getOpcode() == clang::BO_Comma) {
+    emitMessageValue(bop, "warning", "comma operator",
         "We recommend not using the comma operator!");
     return true;
   }
 
-  rapidjson::Value leftValue;
-  TRY_TO(TraverseStmt(bop->getLHS()));
-  leftValue = sonValue;
-
-  rapidjson::Value rightValue;
-  TRY_TO(TraverseStmt(bop->getRHS()));
-  rightValue = sonValue;
-
-  rapidjson::Value binOpValue = createBinOpValue(opString, leftValue, rightValue);
-  addPos(binOpValue, bop);
+  // Operators nested in this one are translated here, with a stack of their
+  // own, so long expressions do not take native stack. Each entry keeps the
+  // sides of the operator already begun.
+  const size_t base = binaryStack.size();
+  beginBinaryOperator(bop);
+  binaryStack.push_back(std::make_pair(bop, 0u));
+  while (binaryStack.size() > base) {
+    clang::BinaryOperator* current = binaryStack.back().first;
+    const unsigned side = binaryStack.back().second++;
+    if (side > 0) out.endMember();
+    if (side == 2) {
+      addId();
+      addPos(current);
+      out.EndObject();
+      binaryStack.pop_back();
+      continue;
+    }
 
-  sonValue = binOpValue;
+    clang::Stmt* child = side == 0 ? current->getLHS() : current->getRHS();
+    out.beginMember(side == 0 ? "left" : "right");
+    auto nested =
+        llvm::dyn_cast_or_null<clang::BinaryOperator>(unwrapStmt(child));
+    if (nested && nested->getOpcode() != clang::BO_Comma) {
+      enterWrapped(child, nested);
+      beginBinaryOperator(nested);
+      binaryStack.push_back(std::make_pair(nested, 0u));
+    }
+    else if (!TraverseStmt(child)) {
+      binaryStack.resize(base);
+      return false;
+    }
+  }
   return true;
 }
 
+void SuperastCPP::beginBinaryOperator(clang::BinaryOperator* bop) {
+  out.StartObject();
+  out.Key("type");
+  out.String(BINARY_OP_NAMES[bop->getOpcode()]);
+}
+
 // Dispatch to binary operator
 bool SuperastCPP::TraverseCompoundAssignOperator(clang::CompoundAssignOperator* caop) {
   return TraverseBinaryOperator(caop);
@@ -304,58 +359,51 @@ bool SuperastCPP::TraverseCXXOperatorCallExpr(clang::CXXOperatorCallExpr* operat
     std::cerr << "Unknown function in CXXOperatorCallExpr" << std::endl;
     return true;
   }
-  const std::string functionName = decl->getNameInfo().getAsString();
-  if (functionName == PRINT_NAME || functionName == READ_NAME) {
+  const clang::OverloadedOperatorKind op = decl->getOverloadedOperator();
+  if (op == clang::OO_LessLess || op == clang::OO_GreaterGreater) {
     bool isFirst = false;
     if (!iofunctionStarted) {
       isFirst = true;
       iofunctionStarted = true;
     }
 
-    rapidjson::Value arrayValue(rapidjson::kArrayType);
-    for (unsigned i = 0; i < operatorCallExpr->getNumArgs(); ++i) {
-      TRY_TO(TraverseStmt(operatorCallExpr->getArg(i)));
-      if (i == 0) {
-        // If sonValue is not an array, is because it reached the begin of
-        // call, which is the cout/cerr/stream class
-        if (sonValue.IsArray()) {
-          arrayValue = sonValue;
-        }
-      }
-      else {
-        arrayValue.PushBack(sonValue, allocator);
-      }
+    if (isFirst) {
+      out.StartObject();
+      out.Key("type");
+      out.String("function-call");
+      out.Key("name");
+      if (op == clang::OO_LessLess) out.String("print");
+      else out.String("read");
+      out.Key("arguments");
     }
-    
-    if (!isFirst) {
-      sonValue = arrayValue;
-    }
-    else {
+
+    // The rest of the chain adds its arguments to the ones of the first call
+    const bool flatten = !isFirst && out.inElements();
+    if (!flatten) out.StartArray();
+    TRY_TO(traverseIOArguments(operatorCallExpr));
+    if (!flatten) out.EndArray();
+
+    if (isFirst) {
       iofunctionStarted = false;
 
-      rapidjson::Value functionValue(rapidjson::kObjectType);
-      addId(functionValue);
-      addPos(functionValue, operatorCallExpr);
-      functionValue.AddMember("type", "function-call", allocator);
-      if (functionName == PRINT_NAME) 
-        functionValue.AddMember("name", "print", allocator);
-      else functionValue.AddMember("name", "read", allocator);
-      functionValue.AddMember("arguments", arrayValue, allocator);
-      sonValue = functionValue;
+      addId();
+      addPos(operatorCallExpr);
+      out.EndObject();
     }
   }
-  else if (functionName == VECTOR_POS_NAME) {
+  else if (op == clang::OO_Subscript) {
     // Operator []
-    TRY_TO(TraverseStmt(operatorCallExpr->getArg(0)));
-    rapidjson::Value leftValue(rapidjson::kObjectType);
-    leftValue = sonValue;
-    TRY_TO(TraverseStmt(operatorCallExpr->getArg(1)));
-    rapidjson::Value rightValue(rapidjson::kObjectType);
-    rightValue = sonValue;
-    sonValue = createBinOpValue("[]", leftValue, rightValue);
+    out.StartObject();
+    out.Key("type");
+    out.String("[]");
+    TRY_TO(traverseMember("left", operatorCallExpr->getArg(0)));
+    TRY_TO(traverseMember("right", operatorCallExpr->getArg(1)));
+    addId();
+    out.EndObject();
   }
   else {
-    std::cerr << "Operator call not defined: " << functionName << std::endl;
+    std::cerr << "Operator call not defined: "
+              << decl->getNameInfo().getAsString() << std::endl;
   }
     return true;
 }
@@ -368,41 +416,46 @@ bool SuperastCPP::TraverseCXXMemberCallExpr(
   // Implicit obj
   clang::Expr* objectExpr = memberCall->getImplicitObjectArgument();
   // If this is an implicitCast, get the subExpr
-  if (clang::ImplicitCastExpr* implicitExpr = 
+  if (clang::ImplicitCastExpr* implicitExpr =
       llvm::dyn_cast<clang::ImplicitCastExpr>(objectExpr)) {
     objectExpr = implicitExpr->getSubExpr();
   }
 
-  const std::string& methodName = methodDecl->getNameInfo().getAsString();
   //const clang::Type* type = methodDecl->getReturnType().getTypePtr();
 
-  rapidjson::Value rightValue(rapidjson::kObjectType);
-  addId(rightValue);
-  addPos(rightValue, memberCall);
-  rightValue.AddMember("type", "function-call", allocator);
-  rightValue.AddMember("name",
-                      rapidjson::Value().SetString(methodName.c_str(),
-                                                   methodName.size(),
-                                                   allocator),
-                      allocator);
+  out.StartObject();
+  out.Key("type");
+  out.String(".");
+
+  // The call is translated before the object
+  out.Key("right");
+  out.StartObject();
+  addId();
+  addPos(memberCall);
+  out.Key("type");
+  out.String("function-call");
+  out.Key("name");
+  emitName(methodDecl->getDeclName());
 
   // For each argument
-  rapidjson::Value arrayValue(rapidjson::kArrayType);
+  out.Key("arguments");
+  out.StartArray();
   for (auto arg : memberCall->arguments()) {
-    TRY_TO(TraverseStmt(arg));
-    arrayValue.PushBack(sonValue, allocator);
+    TRY_TO(traverseValue(arg));
   }
-  rightValue.AddMember("arguments", arrayValue, allocator);
+  out.EndArray();
 
   // Uncomment to add the type
-  //rightValue.AddMember("return-type", createTypeValue(type), allocator);
-  
-  TRY_TO(TraverseStmt(objectExpr));
+  //out.Key("return-type");
+  //emitTypeValue(type);
+  out.EndObject();
+
   // Object from which the method is called
-  rapidjson::Value memberCallValue = createBinOpValue(".", sonValue, rightValue);
-  addPos(memberCallValue, memberCall);
+  TRY_TO(traverseMember("left", objectExpr));
 
-  sonValue = memberCallValue;
+  addId();
+  addPos(memberCall);
+  out.EndObject();
   return true;
 }
 
@@ -411,72 +464,82 @@ bool SuperastCPP::TraverseCXXMemberCallExpr(
 // Translate to binary operator with operator []
 bool SuperastCPP::TraverseMemberExpr(clang::MemberExpr* memberExpr) {
   // Accessing a member. Translate into binary operator []
-  // Save current status
-  const std::string opString = "[]";
-
-  rapidjson::Value leftValue;
-  TRY_TO(TraverseStmt(memberExpr->getBase()));
-  leftValue = sonValue;
-
-  // Build right value from Declaration
-  rapidjson::Value rightValue;
-  TRY_TO(TraverseDecl(memberExpr->getMemberDecl()));
-  rightValue = sonValue;
-
+  out.StartObject();
+  out.Key("type");
+  out.String("[]");
+
+  TRY_TO(traverseMember("left", memberExpr->getBase()));
+
+  // Build right value from Declaration. It keeps the ids of the translated
+  // declaration, but only its position
+  clang::ValueDecl* memberDecl = memberExpr->getMemberDecl();
+  const unsigned rightId = currentId;
+  TRY_TO(traverseDiscarded(memberDecl));
+  if (currentId == rightId) ++currentId;
+
+  out.Key("right");
+  out.StartObject();
+  addId(rightId);
+  addPos(memberDecl);
   // Instead of data-type, just a type 'string'
-  rightValue.AddMember("type", "string", allocator);
-  rightValue.EraseMember(rightValue.FindMember("data-type"));
+  out.Key("type");
+  out.String("string");
   // The id as 'value', not 'name'
-  rightValue.AddMember("value", rightValue["name"], allocator);
-  rightValue.EraseMember(rightValue.FindMember("name"));
-      
-  rapidjson::Value memberExprValue = createBinOpValue(opString, leftValue, rightValue);
-  addPos(memberExprValue, memberExpr);
+  out.Key("value");
+  emitName(memberDecl->getDeclName());
+  out.EndObject();
 
-  sonValue = memberExprValue;
+  addId();
+  addPos(memberExpr);
+  out.EndObject();
   return true;
 }
 
 // DECL REF EXPR. Contains the Identifiers, but also cin/count/endl/cerr
 bool SuperastCPP::TraverseDeclRefExpr(clang::DeclRefExpr* declRefExpr) {
-  const std::string& name = declRefExpr->getNameInfo().getAsString();
-  const std::string& typeName = declRefExpr->getType().getAsString();
-
-  // Cout / Cin / Cerr / Unused flag
-  if (typeName == PRINT_TYPE || typeName == READ_TYPE || 
-      (typeName == PRINT_FLAG_TYPE && name != "endl")) {
-    return true;
-  }
-
-  rapidjson::Value identifierValue;
-
-  if (typeName == PRINT_FLAG_TYPE) {
-    identifierValue = rapidjson::Value(rapidjson::kObjectType);
-    addId(identifierValue);
-    addPos(identifierValue, declRefExpr);
-    if (name == "endl") {
-      identifierValue.AddMember("type", "string", allocator);
-      identifierValue.AddMember("value", "\n", allocator);
+  const clang::Decl* decl = declRefExpr->getDecl()->getCanonicalDecl();
+
+  // Cout / Cin / Cerr
+  if (ioObjects.count(decl)) return true;
+
+  // Endl / Unused flag
+  if (auto function = llvm::dyn_cast<clang::FunctionDecl>(decl)) {
+    clang::FunctionTemplateDecl* manipulator = function->getPrimaryTemplate();
+    if (manipulator && ioManipulators.count(manipulator->getCanonicalDecl())) {
+      if (manipulator->getCanonicalDecl() != endlDecl) return true;
+      out.StartObject();
+      addId();
+      addPos(declRefExpr);
+      out.Key("type");
+      out.String("string");
+      out.Key("value");
+      out.String("\n");
+      out.EndObject();
+      return true;
     }
   }
-  else {
-    identifierValue = createIdentifierValue(name);
-    addId(identifierValue);
-    addPos(identifierValue, declRefExpr);
-  }
 
-  sonValue = identifierValue;
+  out.StartObject();
+  out.Key("type");
+  out.String("identifier");
+  out.Key("value");
+  emitName(declRefExpr->getNameInfo().getName());
+  addId();
+  addPos(declRefExpr);
+  out.EndObject();
+
   return true;
 }
 
 // INTEGER LITERAL
 bool SuperastCPP::TraverseIntegerLiteral(clang::IntegerLiteral* lit) {
   int64_t value = lit->getValue().getSExtValue();
-  rapidjson::Value integerValue = createIntegerValue(value);
-  addId(integerValue);
-  addPos(integerValue, lit);
+  beginLiteralValue("int");
+  out.Int64(value);
+  addId();
+  addPos(lit);
+  out.EndObject();
 
-  sonValue = integerValue;
   return true;
 }
 
@@ -484,97 +547,90 @@ bool SuperastCPP::TraverseIntegerLiteral(clang::IntegerLiteral* lit) {
 // FLOATING LITERAL
 bool SuperastCPP::TraverseFloatingLiteral(clang::FloatingLiteral* lit) {
   double value = lit->getValueAsApproximateDouble();
-  rapidjson::Value floatingValue = createFloatingValue(value);
-  addId(floatingValue);
-  addPos(floatingValue, lit);
+  beginLiteralValue("double");
+  out.Double(value);
+  addId();
+  addPos(lit);
+  out.EndObject();
 
-  sonValue = floatingValue;;
   return true;
 }
 
 // Character literal
 bool SuperastCPP::TraverseCharacterLiteral(clang::CharacterLiteral* lit) {
   std::string value = std::string(1,char(lit->getValue()));
-  rapidjson::Value stringValue = createStringValue(value);
-  addId(stringValue);
-  addPos(stringValue, lit);
+  beginLiteralValue("string");
+  out.String(value.c_str(), value.size());
+  addId();
+  addPos(lit);
+  out.EndObject();
 
-  sonValue = stringValue;;
   return true;
 }
 
 // STRING LITERAL
 bool SuperastCPP::TraverseStringLiteral(clang::StringLiteral* lit) {
-  std::string value = lit->getString().str();
-  rapidjson::Value stringValue = createStringValue(value);
-  addId(stringValue);
-  addPos(stringValue, lit);
+  // The bytes are kept by the AST
+  const llvm::StringRef value = lit->getString();
+  beginLiteralValue("string");
+  out.String(value.data(), value.size(), false);
+  addId();
+  addPos(lit);
+  out.EndObject();
 
-  sonValue = stringValue;;
   return true;
 }
 
 // BOOL LITERAL
 bool SuperastCPP::TraverseCXXBoolLiteralExpr(clang::CXXBoolLiteralExpr* lit) {
   bool value = lit->getValue();
-  rapidjson::Value boolValue = createBoolValue(value);
-  addId(boolValue);
-  addPos(boolValue, lit);
+  beginLiteralValue("bool");
+  out.Bool(value);
+  addId();
+  addPos(lit);
+  out.EndObject();
 
-  sonValue = boolValue;;
   return true;
 }
 
 bool SuperastCPP::TraverseFunctionDecl(clang::FunctionDecl* functionDecl) {
+  out.StartObject();
+  addId();
+  addPos(functionDecl);
 
-  const std::string functionName = functionDecl->getNameInfo().getAsString();
-
-  rapidjson::Value functionValue(rapidjson::kObjectType);
-  addId(functionValue);
-  addPos(functionValue, functionDecl);
-  
-  functionValue.AddMember("type", "function-declaration", allocator);
+  out.Key("type");
+  out.String("function-declaration");
   // Add the name
-  functionValue.AddMember(
-      "name", 
-      rapidjson::Value().SetString(functionName.c_str(), 
-                                   functionName.size(),
-                                   allocator), 
-      allocator);
+  out.Key("name");
+  emitName(functionDecl->getDeclName());
 
   // Add the return type
   clang::QualType qualType = functionDecl->getCallResultType().getNonLValueExprType(*context);
-  functionValue.AddMember("return-type", createTypeValue((qualType.getTypePtr())), allocator);
+  addType("return-type", qualType.getTypePtr());
 
   // Array of parameters
-  rapidjson::Value parametersValue(rapidjson::kArrayType);
+  out.Key("parameters");
+  out.StartArray();
 
   // Traverse parameters
   for (unsigned int i = 0; i < functionDecl->param_size(); ++i) {
-    TRY_TO(TraverseDecl(functionDecl->getParamDecl(i)));
-
-    // Add the parameter to array
-    parametersValue.PushBack(sonValue, allocator);
+    TRY_TO(traverseValue(functionDecl->getParamDecl(i)));
   }
 
-  // Add parameters to functionValue
-  functionValue.AddMember("parameters", parametersValue, allocator);
-  
+  out.EndArray();
+
   // If this is a function definition, traverse definition.
+  out.Key("block");
   if (functionDecl->isThisDeclarationADefinition()) {
-    TRY_TO(TraverseStmt(functionDecl->getBody()));
-    ensureSonIsArray();
-    rapidjson::Value blockValue = createBlockValue(sonValue);
-    functionValue.AddMember("block", blockValue, allocator);
+    TRY_TO(traverseBlock(functionDecl->getBody()));
   }
   else {
     // If not definition, add empty block
-    rapidjson::Value emptyArray(rapidjson::kArrayType);
-    functionValue.AddMember("block", createBlockValue(emptyArray), allocator);
+    TRY_TO(traverseBlock(nullptr));
   }
 
   // END BODY TRAVERSE
-  sonValue = functionValue;
+  out.EndObject();
   return true;
 }
 
@@ -591,6 +647,7 @@ bool SuperastCPP::TraverseDecl(clang::Decl* D) {
   if (!D || !context->getSourceManager().isInMainFile(D->getLocStart())) {
     return true;
   }
+  if (stats) ++stats->nodes[std::string(D->getDeclKindName()) + "Decl"];
   // Default call. This will call each TraverseCLASSNAME.
   return RecursiveASTVisitor::TraverseDecl(D);
 }
@@ -598,80 +655,121 @@ bool SuperastCPP::TraverseDecl(clang::Decl* D) {
 // The AST entry point. Here begins everything.
 bool SuperastCPP::TraverseTranslationUnitDecl(
     clang::TranslationUnitDecl* unitDecl) {
-  // Create the block object at root of DOM
-  document.SetObject();
+  resolveIODecls(unitDecl);
+
+  // Streaming, each statement is a root value of its own
+  if (streamStatements) {
+    // The root would take the first id
+    ++currentId;
+    out.beginElements(false);
+    for (auto declaration : unitDecl->decls()) {
+      TRY_TO(TraverseDecl(declaration));
+    }
+    out.endElements();
+    if (stats) stats->ids += currentId;
+    return true;
+  }
+
+  // Statements that did not change since a previous translation are copied,
+  // and the translated nodes take ids after all of theirs
+  const bool reusing = reuse && reuse->begin(*context, unitDecl);
+  if (reusing) currentId = reuse->getFirstId();
 
-  // Set the pointer. Statements from root will be added here
-  addId(document);
-  document.AddMember("statements", rapidjson::kArrayType, allocator);
+  // Create the block object at root
+  out.StartObject();
+  addId();
 
+  // Statements from root will be added here
+  out.Key("statements");
+  out.StartArray();
+  out.beginElements(false);
   for (auto declaration : unitDecl->decls()) {
+    if (reusing && reuse->copy(declaration, out)) continue;
     TRY_TO(TraverseDecl(declaration));
-    if (!sonValue.IsNull()) {
-      if (sonValue.IsArray()) {
-        addElemsToArray(document["statements"], sonValue);
+  }
+  out.endElements();
+  out.EndArray();
+
+  out.EndObject();
+  if (stats) stats->ids += currentId;
+  return true;
+}
+
+// IOSTREAM DECLARATIONS, looked up once so references compare pointers
+void SuperastCPP::resolveIODecls(clang::TranslationUnitDecl* unitDecl) {
+  ioObjects.clear();
+  ioManipulators.clear();
+  endlDecl = nullptr;
+  for (clang::NamedDecl* found : unitDecl->lookup(&context->Idents.get("std"))) {
+    auto stdNamespace = llvm::dyn_cast<clang::NamespaceDecl>(found);
+    if (!stdNamespace) continue;
+    for (const char* name : IO_OBJECT_NAMES) {
+      for (clang::NamedDecl* decl :
+           stdNamespace->lookup(&context->Idents.get(name))) {
+        if (llvm::isa<clang::VarDecl>(decl)) {
+          ioObjects.insert(decl->getCanonicalDecl());
+        }
       }
-      else {
-        document["statements"].PushBack(sonValue, allocator);
+    }
+    for (const char* name : IO_MANIPULATOR_NAMES) {
+      for (clang::NamedDecl* decl :
+           stdNamespace->lookup(&context->Idents.get(name))) {
+        if (!llvm::isa<clang::FunctionTemplateDecl>(decl)) continue;
+        ioManipulators.insert(decl->getCanonicalDecl());
+        if (decl->getName() == "endl") endlDecl = decl->getCanonicalDecl();
       }
     }
   }
-  return true;
 }
 
 // Traverse VAR DECL
 bool SuperastCPP::TraverseVarDecl(clang::VarDecl* var) {
-  const std::string varName = var->getName().str();
 
-  rapidjson::Value varValue(rapidjson::kObjectType);
-  addId(varValue);
-  addPos(varValue, var);
+  out.StartObject();
+  addId();
+  addPos(var);
 
   // Variable Declaration if it is not a parameter of a function
   if (!clang::dyn_cast<clang::ParmVarDecl>(var)) {
-    varValue.AddMember("type", "variable-declaration", allocator);
+    out.Key("type");
+    out.String("variable-declaration");
   }
-  
-  varValue.AddMember("name", 
-                     rapidjson::Value().SetString(varName.c_str(), 
-                                                  varName.size(), 
-                                                  allocator), 
-                     allocator);
-
-  // NonLValueExpr to remove LValueExpression for references. 
+
+  out.Key("name");
+  emitName(var->getDeclName());
+
+  // NonLValueExpr to remove LValueExpression for references.
   // There are more options
   clang::QualType qualType = var->getType().getNonLValueExprType(*context);
   const clang::Type* type = qualType.getTypePtr();
   bool isConst = var->getType().isConstQualified() | qualType.isConstQualified();
 
   //std::cerr << " type: " << type->getCanonicalTypeInternal().getAsString();
-  varValue.AddMember("data-type", createTypeValue(type), allocator);
-  varValue.AddMember("is-reference", var->getType()->isReferenceType(), allocator);
-  varValue.AddMember("is-const", isConst, allocator);
-  
+  addType("data-type", type);
+  out.Key("is-reference");
+  out.Bool(var->getType()->isReferenceType());
+  out.Key("is-const");
+  out.Bool(isConst);
 
-  if (var->hasInit() && !type->isStructureType() && 
-      !isSTLVectorType(type->getCanonicalTypeInternal())) {
-    rapidjson::Value exprValue(rapidjson::kObjectType);
-    TRY_TO(TraverseStmt(var->getInit()));
 
+  if (var->hasInit() && !type->isStructureType() &&
+      getTypeInfo(type).vectorDepth == 0) {
     clang::VarDecl::InitializationStyle initStyle = var->getInitStyle();
     switch (initStyle) {
       case clang::VarDecl::CInit:
       case clang::VarDecl::CallInit:
         // We don't distinguis between these two initializations
-        if (!sonValue.IsNull()) {
-          varValue.AddMember("init", sonValue, allocator);
-        }
         // Call style initializer (int x(1))
+        TRY_TO(traverseMember("init", var->getInit(), true));
         break;
       case clang::VarDecl::ListInit:
         // C++11 Initializer list. Not supported by us.
+        TRY_TO(traverseDiscarded(var->getInit()));
         break;
     }
   }
 
-  sonValue = varValue;
+  out.EndObject();
   return true;
 }
 
@@ -679,29 +777,18 @@ bool SuperastCPP::TraverseParmVarDecl(clang::ParmVarDecl* parmVarDecl) {
   return TraverseVarDecl(parmVarDecl);
 }
 
+// Will be an element of the attributes in struct decl. Otherwise, just a call.
 bool SuperastCPP::TraverseFieldDecl(clang::FieldDecl* fieldDecl) {
 
-  const std::string varName = fieldDecl->getName().str();
-
-  rapidjson::Value varValue(rapidjson::kObjectType);
-  addId(varValue);
-  addPos(varValue, fieldDecl);
-  varValue.AddMember("name", 
-                     rapidjson::Value().SetString(varName.c_str(), 
-                                                  varName.size(), 
-                                                  allocator), 
-                     allocator);
+  out.StartObject();
+  addId();
+  addPos(fieldDecl);
+  out.Key("name");
+  emitName(fieldDecl->getDeclName());
 
   clang::QualType qualType = fieldDecl->getType().getNonLValueExprType(*context);
-  varValue.AddMember("data-type", createTypeValue((qualType.getTypePtr())), allocator);
-
-  // Will be an array in struct decl. Otherwise, just a call.
-  if (sonValue.IsArray()) {
-    sonValue.PushBack(varValue, allocator);
-  }
-  else {
-    sonValue = varValue;
-  }
+  addType("data-type", qualType.getTypePtr());
+  out.EndObject();
 
   return true;
 }
@@ -712,30 +799,29 @@ bool SuperastCPP::TraverseCXXRecordDecl(clang::CXXRecordDecl* cxxRecordDecl) {
   const bool isValid = true;
   bool returnValue = true;
 
-  rapidjson::Value structValue(rapidjson::kObjectType);
-  addId(structValue);
-  addPos(structValue, cxxRecordDecl);
-
   if (!isValid) {
-    structValue.AddMember("type", "invalid", allocator);
-    structValue = createMessageValue(cxxRecordDecl, "error", "Struct decl", 
+    emitMessageValue(cxxRecordDecl, "error", "Struct decl",
       "Invalid struct declaration");
-  }
-  else {
-    const std::string structName = cxxRecordDecl->getNameAsString();
-    structValue.AddMember("type", "struct-declaration", allocator);
-    structValue.AddMember("name",
-                          rapidjson::Value().SetString(structName.c_str(),
-                                                       structName.size(),
-                                                       allocator),
-                          allocator);
-
-    sonValue = rapidjson::Value(rapidjson::kArrayType);
-    returnValue = RecursiveASTVisitor::TraverseCXXRecordDecl(cxxRecordDecl);
-    structValue.AddMember("attributes", sonValue, allocator);
+    return returnValue;
   }
 
-  sonValue = structValue;
+  out.StartObject();
+  addId();
+  addPos(cxxRecordDecl);
+  out.Key("type");
+  out.String("struct-declaration");
+  out.Key("name");
+  emitName(cxxRecordDecl->getDeclName());
+
+  // The fields add themselves to the attributes
+  out.Key("attributes");
+  out.StartArray();
+  out.beginElements(false);
+  returnValue = RecursiveASTVisitor::TraverseCXXRecordDecl(cxxRecordDecl);
+  out.endElements();
+  out.EndArray();
+
+  out.EndObject();
   return returnValue;
 }
 
@@ -747,11 +833,9 @@ bool SuperastCPP::TraverseCXXMethodDecl(clang::CXXMethodDecl* D) {
   }
 
   // Just ignore the method decl
-  //assert(sonValue.IsArray());
   //const std::string declString = D->getNameAsString();
-  //sonValue.PushBack(createMessageValue(D, "error", "method decl",
-      //"Error declaring method '" + declString + "'. No method decl allowed"),
-      //allocator);
+  //emitMessageValue(D, "error", "method decl",
+      //"Error declaring method '" + declString + "'. No method decl allowed");
   return true;
 }
 
@@ -765,26 +849,22 @@ bool SuperastCPP::TraverseCallExpr(clang::CallExpr* call) {
     return true;
   }
 
-  const std::string functionName = decl->getNameInfo().getAsString();
+  out.StartObject();
+  addId();
+  addPos(call);
+  out.Key("type");
+  out.String("function-call");
+  out.Key("name");
+  emitName(decl->getDeclName());
 
-  rapidjson::Value functionCallValue(rapidjson::kObjectType);
-  addId(functionCallValue);
-  addPos(functionCallValue, call);
-  functionCallValue.AddMember("type", "function-call", allocator);
-  rapidjson::Value nameValue(functionName.c_str(), 
-                             functionName.size(), 
-                             allocator);
-  functionCallValue.AddMember("name", nameValue, allocator);
-
-  rapidjson::Value argumentsValue(rapidjson::kArrayType);
+  out.Key("arguments");
+  out.StartArray();
   for (auto arg : call->arguments()) {
-    TRY_TO(TraverseStmt(arg));
-    argumentsValue.PushBack(sonValue, allocator);
+    TRY_TO(traverseValue(arg));
   }
+  out.EndArray();
 
-  functionCallValue.AddMember("arguments", argumentsValue, allocator);
-  
-  sonValue = functionCallValue;
+  out.EndObject();
   return true;
 }
 
@@ -795,325 +875,352 @@ bool SuperastCPP::TraverseDeclStmt(clang::DeclStmt* declStmt) {
     TRY_TO(TraverseDecl(declStmt->getSingleDecl()));
   }
   else {
-    // Group of  declStmt
-    rapidjson::Value arrayValue(rapidjson::kArrayType);
+    // Group of  declStmt. Inside a block, added to its array
+    const bool flatten = out.inElements();
+    if (flatten) out.markFlattened();
+    else out.StartArray();
     const clang::DeclGroupRef declGroup = declStmt->getDeclGroup();
     for (auto iterator = declGroup.begin(); iterator != declGroup.end(); ++iterator) {
-      TRY_TO(TraverseDecl(*iterator));
-      arrayValue.PushBack(sonValue, allocator);
+      TRY_TO(traverseValue(*iterator));
     }
-    sonValue = arrayValue;
+    if (!flatten) out.EndArray();
   }
   return true;
 }
 
 
 bool SuperastCPP::TraverseBreakStmt(clang::BreakStmt* breakStmt) {
-  sonValue = createMessageValue(breakStmt, "error", "break statement", 
+  emitMessageValue(breakStmt, "error", "break statement",
       "Breaks are not allowed");
   return true;
 }
 
 bool SuperastCPP::TraverseLabelStmt(clang::LabelStmt* gotoStmt) {
-  sonValue = createMessageValue(gotoStmt, "error", "label",
+  emitMessageValue(gotoStmt, "error", "label",
       "Labels are not allowed");
   return true;
 }
 
 bool SuperastCPP::TraverseGotoStmt(clang::GotoStmt* gotoStmt) {
-  sonValue = createMessageValue(gotoStmt, "error", "goto",
+  emitMessageValue(gotoStmt, "error", "goto",
       "Goto is not allowed");
   return true;
 }
 
-void SuperastCPP::addId(rapidjson::Value& object) {
-  object.AddMember("id", currentId++, allocator);
+void SuperastCPP::addId() {
+  addId(currentId++);
 }
 
-void SuperastCPP::addLine(rapidjson::Value& object, clang::Stmt* stmt) {
-  clang::FullSourceLoc loc = context->getFullLoc(stmt->getLocStart());
-  int lineNumber = -1;
-  if (loc.isValid()) lineNumber = loc.getSpellingLineNumber();
-  object.AddMember("line", lineNumber, allocator);
+void SuperastCPP::addId(unsigned id) {
+  if (!fields.id) return;
+  out.Key("id");
+  out.Uint(id);
 }
 
-void SuperastCPP::addLine(rapidjson::Value& object, clang::Decl* decl) {
-  clang::FullSourceLoc loc = context->getFullLoc(decl->getLocStart());
-  int lineNumber = -1;
-  if (loc.isValid()) lineNumber = loc.getSpellingLineNumber();
-  object.AddMember("line", lineNumber, allocator);
+void SuperastCPP::addPos(clang::SourceLocation loc) {
+  if (!writeLine && !writeColumn && !writeOffset) return;
+  const SourcePositions::Position position = positions.get(loc);
+  if (writeLine) {
+    out.Key("line");
+    out.Int(position.line);
+  }
+  if (writeColumn) {
+    out.Key("column");
+    out.Int(position.column);
+  }
+  if (writeOffset) {
+    out.Key("offset");
+    out.Int(position.offset);
+  }
 }
 
-void SuperastCPP::addCol(rapidjson::Value& object, clang::Stmt* stmt) {
-  clang::FullSourceLoc loc = context->getFullLoc(stmt->getLocStart());
-  int colNumber = -1;
-  if (loc.isValid()) colNumber = loc.getSpellingColumnNumber();
-  object.AddMember("column", colNumber, allocator);
+void SuperastCPP::addPos(clang::Stmt* stmt) {
+  addPos(stmt->getLocStart());
 }
 
-void SuperastCPP::addCol(rapidjson::Value& object, clang::Decl* decl) {
-  clang::FullSourceLoc loc = context->getFullLoc(decl->getLocStart());
-  int colNumber = -1;
-  if (loc.isValid()) colNumber = loc.getSpellingColumnNumber();
-  object.AddMember("column", colNumber, allocator);
+void SuperastCPP::addPos(clang::Decl* decl) {
+  addPos(decl->getLocStart());
 }
 
-void SuperastCPP::addPos(rapidjson::Value& object, clang::Stmt* stmt) {
-  addLine(object, stmt);
-  addCol(object, stmt);
+bool SuperastCPP::traverseMember(const char* key, clang::Stmt* stmt,
+                                 bool optional) {
+  out.beginMember(key, optional);
+  const bool result = TraverseStmt(stmt);
+  out.endMember();
+  return result;
 }
 
-void SuperastCPP::addPos(rapidjson::Value& object, clang::Decl* decl) {
-  addLine(object, decl);
-  addCol(object, decl);
+bool SuperastCPP::traverseValue(clang::Stmt* stmt) {
+  out.beginValue();
+  const bool result = TraverseStmt(stmt);
+  out.endValue();
+  return result;
 }
 
-void SuperastCPP::ensureSonIsArray() {
-  if (!sonValue.IsArray()) {
-    rapidjson::Value arrayValue(rapidjson::kArrayType);
-    if (!sonValue.IsNull()) {
-      arrayValue.PushBack(sonValue, allocator);
-    }
-    sonValue = arrayValue;
-  }
+bool SuperastCPP::traverseValue(clang::Decl* decl) {
+  out.beginValue();
+  const bool result = TraverseDecl(decl);
+  out.endValue();
+  return result;
+}
+
+bool SuperastCPP::traverseElements(clang::Stmt* stmt, bool nullIfEmpty) {
+  out.beginElements(nullIfEmpty);
+  const bool result = TraverseStmt(stmt);
+  out.endElements();
+  return result;
+}
+
+bool SuperastCPP::traverseDiscarded(clang::Stmt* stmt) {
+  out.beginDiscard();
+  const bool result = TraverseStmt(stmt);
+  out.endDiscard();
+  return result;
+}
+
+bool SuperastCPP::traverseDiscarded(clang::Decl* decl) {
+  out.beginDiscard();
+  const bool result = TraverseDecl(decl);
+  out.endDiscard();
+  return result;
+}
+
+// The id of the block is taken after its statements
+bool SuperastCPP::traverseBlock(clang::Stmt* body) {
+  beginBlock();
+  const bool result = TraverseStmt(body);
+  endBlock();
+  return result;
+}
+
+void SuperastCPP::beginBlock() {
+  out.StartObject();
+  out.Key("statements");
+  out.StartArray();
+  out.beginElements(false);
 }
 
-void SuperastCPP::addElemsToArray(rapidjson::Value& parentValue,
-    rapidjson::Value& elemsValue) {
-  assert(parentValue.IsArray());
-  assert(elemsValue.IsArray());
-  for (unsigned i = 0; i < elemsValue.Size(); ++i) {
-    parentValue.PushBack(elemsValue[i], allocator);
+void SuperastCPP::endBlock() {
+  out.endElements();
+  out.EndArray();
+  addId();
+  out.EndObject();
+}
+
+// Adds the member key with the type. Without it, only takes its ids.
+void SuperastCPP::addType(const char* key, const clang::Type* type) {
+  if (!fields.dataType) {
+    currentId += getTypeInfo(type).vectorDepth + 1;
+    return;
   }
+  out.Key(key);
+  emitTypeValue(type);
 }
 
-rapidjson::Value SuperastCPP::createBlockValue(rapidjson::Value& arrayValue) {
-  rapidjson::Value blockValue(rapidjson::kObjectType);
-  addId(blockValue);
-  blockValue.AddMember("statements", arrayValue, allocator);
-  return blockValue;
+// Emits an object with the type
+void SuperastCPP::emitTypeValue(const std::string& type) {
+  out.StartObject();
+  addId();
+  out.Key("name");
+  out.String(type.c_str(), type.size());
+  out.EndObject();
 }
 
-// Returns a rapidjson Value with the type
-rapidjson::Value SuperastCPP::createTypeValue(const std::string& type) {
-  rapidjson::Value typeValue(rapidjson::kObjectType);
-  rapidjson::Value nameValue(type.c_str(), type.size(), allocator);
-  addId(typeValue);
-  typeValue.AddMember("name", nameValue, allocator);
-  return typeValue;
+// NAME, not copied when clang keeps its spelling in the identifier table
+void SuperastCPP::emitName(const clang::DeclarationName& name) {
+  if (const clang::IdentifierInfo* identifier = name.getAsIdentifierInfo()) {
+    const llvm::StringRef spelling = identifier->getName();
+    out.String(spelling.data(), spelling.size(), false);
+    return;
+  }
+  const std::string spelling = name.getAsString();
+  out.String(spelling.c_str(), spelling.size());
 }
 
 // TYPE VALUE
-rapidjson::Value SuperastCPP::createTypeValue(const clang::Type* type) {
-  // Check if it is vector
-  
-  if (isSTLVectorType(type->getCanonicalTypeInternal()))
-    return createVectorValue(type->getCanonicalTypeInternal());
-  if (type->isBooleanType()) return createTypeValue("bool");
-  if (type->isIntegerType()) return createTypeValue("int");
-  if (type->isFloatingType()) return createTypeValue("double");
-  if (type->isVoidType()) return createTypeValue("void");
-  if (type->isAnyCharacterType()) return createTypeValue("string");
+void SuperastCPP::emitTypeValue(const clang::Type* type) {
+  const TypeInfo& info = getTypeInfo(type);
+  if (info.unknown) {
+    return emitTypeValue("Unknown: (" + std::string(type->getTypeClassName()) + ")");
+  }
+  if (info.vectorDepth > 0) return emitVectorValue(info);
+  emitTypeValue(info.name);
+}
+
+// TYPE INFO, computed once per canonical type
+const SuperastCPP::TypeInfo& SuperastCPP::getTypeInfo(const clang::Type* type) {
+  const clang::Type* canonical = type->getCanonicalTypeInternal().getTypePtr();
+  auto it = typeCache.find(canonical);
+  if (it != typeCache.end()) return it->second;
+  return typeCache.insert(std::make_pair(canonical, classifyType(canonical)))
+      .first->second;
+}
+
+SuperastCPP::TypeInfo SuperastCPP::classifyType(const clang::Type* type) {
+  TypeInfo info;
+  // Check if it is vector, of the translation of its element type
+  if (auto vector = getStdSpecialization(type, "vector")) {
+    const TypeInfo& element =
+        getTypeInfo(vector->getTemplateArgs()[0].getAsType().getTypePtr());
+    info.name = element.unknown ? "Unknown: (" + element.name + ")"
+                                : element.name;
+    info.vectorDepth = element.vectorDepth + 1;
+    return info;
+  }
+  if (type->isBooleanType()) info.name = "bool";
+  else if (type->isIntegerType()) info.name = "int";
+  else if (type->isFloatingType()) info.name = "double";
+  else if (type->isVoidType()) info.name = "void";
+  else if (type->isAnyCharacterType()) info.name = "string";
   // std::string
-  if (type->getCanonicalTypeInternal().getAsString() == STRING_TYPE)
-    return createTypeValue("string");
-  if (type->isStructureType()) {
-    return createTypeValue(type->
-                           getAsStructureType()->
-                           getAsCXXRecordDecl()->
-                           getNameAsString());
+  else if (getStdSpecialization(type, "basic_string")) info.name = "string";
+  else if (type->isStructureType()) {
+    info.name = type->getAsStructureType()->getAsCXXRecordDecl()->getNameAsString();
   }
+  else {
+    info.unknown = true;
+    info.name = type->getTypeClassName();
+  }
+  return info;
+}
+
+// LITERAL VALUE
+void SuperastCPP::beginLiteralValue(const char* type) {
+  out.StartObject();
+  out.Key("type");
+  out.String(type);
+  out.Key("value");
+}
+
+// IF IT IS A SPECIALIZATION OF A TEMPLATE OF NAMESPACE STD
+const clang::ClassTemplateSpecializationDecl*
+SuperastCPP::getStdSpecialization(const clang::Type* type, llvm::StringRef name) {
+  auto specialization =
+      llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+          type->getAsCXXRecordDecl());
+  if (!specialization || !specialization->isInStdNamespace()) return nullptr;
+  if (specialization->getTemplateArgs().size() == 0) return nullptr;
+  const clang::IdentifierInfo* identifier = specialization->getIdentifier();
+  if (!identifier || identifier->getName() != name) return nullptr;
+  return specialization;
+}
+
+void SuperastCPP::emitVectorValue(const TypeInfo& info) {
+  // The innermost type takes the first id, and each vector the next one
+  const unsigned firstId = currentId;
+  currentId += info.vectorDepth + 1;
+  for (unsigned i = info.vectorDepth; i > 0; --i) {
+    out.StartObject();
+    addId(firstId + i);
+    out.Key("name");
+    out.String("vector");
+    out.Key("data-type");
+  }
+
+  out.StartObject();
+  addId(firstId);
+  out.Key("name");
+  // Copied, as the type cache moves its names when it grows
+  out.String(info.name.c_str(), info.name.size());
+  out.EndObject();
 
-  return createTypeValue("Unknown: (" + std::string(type->getTypeClassName()) + ")");
-}
-
-// BINARY OPERATION VALUE
-rapidjson::Value SuperastCPP::createBinOpValue(const std::string& opcode, 
-                                  rapidjson::Value& leftValue,
-                                  rapidjson::Value& rightValue) {
-  rapidjson::Value binOpValue(rapidjson::kObjectType);
-  addId(binOpValue);
-  binOpValue.AddMember("type",
-                       rapidjson::Value().SetString(opcode.c_str(),
-                                                    opcode.size(),
-                                                    allocator),
-                       allocator);
-  binOpValue.AddMember("left", leftValue, allocator);
-  binOpValue.AddMember("right", rightValue, allocator);
-
-  return binOpValue;
-}
-
-// INTEGER LITERAL VALUE
-rapidjson::Value SuperastCPP::createIntegerValue(const int64_t value) {
-  rapidjson::Value integerValue(rapidjson::kObjectType);
-  integerValue.AddMember("type", "int", allocator);
-  integerValue.AddMember("value", value, allocator);
-
-  return integerValue;
-}
-
-// FLOATING LITERAL VALUE
-rapidjson::Value SuperastCPP::createFloatingValue(const double value) {
-  rapidjson::Value floatingValue(rapidjson::kObjectType);
-  floatingValue.AddMember("type", "double", allocator);
-  floatingValue.AddMember("value", value, allocator);
-
-  return floatingValue;
-}
-
-//STRING LITERAL VALUE
-rapidjson::Value SuperastCPP::createStringValue(const std::string& value) {
-  rapidjson::Value stringValue(rapidjson::kObjectType);
-  stringValue.AddMember("type", "string", allocator);
-  stringValue.AddMember("value", 
-                        rapidjson::Value().SetString(value.c_str(),
-                                                     value.size(),
-                                                     allocator),
-                        allocator);
-  return stringValue;
-}
-
-// BOOL LITERAL VALUE
-rapidjson::Value SuperastCPP::createBoolValue(const bool value) {
-  rapidjson::Value boolValue(rapidjson::kObjectType);
-  boolValue.AddMember("type", "bool", allocator);
-  boolValue.AddMember("value", value, allocator);
-
-  return boolValue;
-}
-
-// IDENTIFIER VALUE
-rapidjson::Value SuperastCPP::createIdentifierValue(const std::string& name) {
-  rapidjson::Value idValue(rapidjson::kObjectType);
-  idValue.AddMember("type", "identifier", allocator);
-  idValue.AddMember("value", 
-                    rapidjson::Value().SetString(name.c_str(),
-                                                 name.size(),
-                                                 allocator),
-                    allocator);
-  return idValue;
-}
-
-// IF IT IS A VECTOR TYPE
-bool SuperastCPP::isSTLVectorType(const clang::QualType qualType) {
-  const std::string& typeName = qualType.getAsString();
-  return typeName.find(VECTOR_TYPE) != std::string::npos;
-}
-
-// GET VECTOR TYPE FROM STRING
-rapidjson::Value SuperastCPP::createVectorValue(const clang::QualType qualType) {
-  assert(isSTLVectorType(qualType));
-
-  //rapidjson::Value vectorValue(rapidjson::kObjectType);
-  //vectorValue.AddMember("id", currentId++, allocator);
-  const std::string& typeName = qualType.getAsString();
-
-  std::size_t actPos = 0;
-  bool finished = false;
-  unsigned depth = 0;
-  std::string innerMostType;
-  while (!finished) {
-    // find next vector or comma
-    std::size_t vectorPos = typeName.find(VECTOR_TYPE, actPos);
-    std::size_t commaPos = typeName.find(",", actPos);
-
-    std::string type = "vector";
-    if (commaPos < vectorPos) {
-      finished = true;
-      innerMostType = typeName.substr(actPos, commaPos-actPos);
-      auto it = VECTOR_TYPE_MAPPING.find(type);
-      if (it != VECTOR_TYPE_MAPPING.end()) innerMostType = it->second;
+  for (unsigned i = 0; i < info.vectorDepth; ++i) out.EndObject();
+}
+
+// ARGUMENTS OF A PRINT/READ CHAIN. The chain nests through the first argument
+// of each call, so it is walked down with a stack of its own and the arguments
+// are added from the innermost call up.
+bool SuperastCPP::traverseIOArguments(clang::CXXOperatorCallExpr* call) {
+  const size_t base = ioStack.size();
+  ioStack.push_back(call);
+  bool result = true;
+  while (result) {
+    clang::Expr* first = ioStack.back()->getArg(0);
+    // If it is not a chain, is because it reached the begin of
+    // call, which is the cout/cerr/stream class
+    if (!isIOChain(first)) {
+      result = traverseDiscarded(first);
+      break;
     }
-    else {
-      actPos = vectorPos + VECTOR_TYPE.size();
-      ++depth;
+    auto nested =
+        llvm::dyn_cast_or_null<clang::CXXOperatorCallExpr>(unwrapStmt(first));
+    if (!nested) {
+      result = traverseElements(first, false);
+      break;
     }
+    out.beginElements(false);
+    enterWrapped(first, nested);
+    ioStack.push_back(nested);
   }
 
-  rapidjson::Value actTypeValue(rapidjson::kObjectType);
-  addId(actTypeValue);
-  actTypeValue.AddMember("name", 
-                         rapidjson::Value().SetString(innerMostType.c_str(),
-                                                      innerMostType.size(),
-                                                      allocator),
-                         allocator);
-
-  for (unsigned i = 0; i < depth; ++i) {
-    rapidjson::Value aux(rapidjson::kObjectType);
-    addId(aux);
-    aux.AddMember("name", "vector", allocator);
-    aux.AddMember("data-type", actTypeValue, allocator);
-    actTypeValue = aux;
+  while (ioStack.size() > base) {
+    clang::CXXOperatorCallExpr* current = ioStack.back();
+    ioStack.pop_back();
+    for (unsigned i = 1; result && i < current->getNumArgs(); ++i) {
+      result = traverseValue(current->getArg(i));
+    }
+    if (ioStack.size() > base) out.endElements();
   }
-  
-  return actTypeValue;
+  return result;
 }
 
-rapidjson::Value SuperastCPP::createMessageValue(clang::Stmt* stmt, const std::string& type,
-    const std::string& value, const std::string& description) {
-  
-  rapidjson::Value object(rapidjson::kObjectType);
-  addId(object);
-  addPos(object, stmt);
-  object.AddMember("type",
-      rapidjson::Value().SetString(type.c_str(), type.size(), allocator),
-      allocator);
-  object.AddMember("value",
-      rapidjson::Value().SetString(value.c_str(), value.size(), allocator),
-      allocator);
-  object.AddMember("description",
-      rapidjson::Value().SetString(description.c_str(), description.size(), allocator),
-      allocator);
-
-  return object;
-}
-
-rapidjson::Value SuperastCPP::createMessageValue(clang::Decl* decl, const std::string& type,
-    const std::string& value, const std::string& description) {
-  
-  rapidjson::Value object(rapidjson::kObjectType);
-  addId(object);
-  addPos(object, decl);
-  object.AddMember("type",
-      rapidjson::Value().SetString(type.c_str(), type.size(), allocator),
-      allocator);
-  object.AddMember("value",
-      rapidjson::Value().SetString(value.c_str(), value.size(), allocator),
-      allocator);
-  object.AddMember("description",
-      rapidjson::Value().SetString(description.c_str(), description.size(), allocator),
-      allocator);
-
-  return object;
+// IF IT CONTINUES A PRINT/READ CHAIN
+bool SuperastCPP::isIOChain(clang::Expr* expr) {
+  auto operatorCallExpr =
+      llvm::dyn_cast<clang::CXXOperatorCallExpr>(expr->IgnoreParenImpCasts());
+  if (!operatorCallExpr) return false;
+  auto decl = llvm::dyn_cast_or_null<clang::FunctionDecl>(
+      operatorCallExpr->getCalleeDecl());
+  if (!decl) return false;
+  const clang::OverloadedOperatorKind op = decl->getOverloadedOperator();
+  return op == clang::OO_LessLess || op == clang::OO_GreaterGreater;
 }
 
-/***************************
- * END SuperastCPP methods
- ***************************/
+void SuperastCPP::emitMessageValue(clang::Stmt* stmt, const std::string& type,
+    const std::string& value, const std::string& description) {
 
-// dump all the json document in a pretty format
-std::ostream& dumpJsonDocument(std::ostream& os, rapidjson::Document& doc) {
-  rapidjson::StringBuffer buffer;
-  rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
-  doc.Accept(writer);
-  // Output DOM
-  return os << buffer.GetString() << std::endl;
+  out.StartObject();
+  addId();
+  addPos(stmt);
+  out.Key("type");
+  out.String(type.c_str(), type.size());
+  out.Key("value");
+  out.String(value.c_str(), value.size());
+  out.Key("description");
+  out.String(description.c_str(), description.size());
+  out.EndObject();
 }
 
-// Main function
-int main(int argc, const char **argv) {
-  clang::tooling::CommonOptionsParser OptionsParser(argc, argv, SuperastCPPCategory);
-  clang::tooling::ClangTool Tool(OptionsParser.getCompilations(),
-                                 OptionsParser.getSourcePathList());
+void SuperastCPP::emitMessageValue(clang::Decl* decl, const std::string& type,
+    const std::string& value, const std::string& description) {
 
-  // Run the recursive visitor
-  int returnValue = Tool.run(
-      clang::tooling::newFrontendActionFactory<SuperastCPPAction>().get());
+  out.StartObject();
+  addId();
+  addPos(decl);
+  out.Key("type");
+  out.String(type.c_str(), type.size());
+  out.Key("value");
+  out.String(value.c_str(), value.size());
+  out.Key("description");
+  out.String(description.c_str(), description.size());
+  out.EndObject();
+}
 
-  // Dump the json to stdin
-  dumpJsonDocument(std::cout, document);
+/***************************
+ * END SuperastCPP methods
+ ***************************/
 
-  // Return
-  return returnValue;
+std::unique_ptr<clang::ASTConsumer> SuperastCPPAction::CreateASTConsumer(
+    clang::CompilerInstance &Compiler, llvm::StringRef) {
+  // The consumer chooses which bodies are skipped. -check-only never looks at
+  // the bodies of the headers.
+  if (options.skipExternalBodies || options.checkOnly) {
+    Compiler.getFrontendOpts().SkipFunctionBodies = true;
+  }
+  if (options.checkOnly) {
+    return std::unique_ptr<clang::ASTConsumer>(new SuperastCheckConsumer(
+        &Compiler.getASTContext(), handler, options));
+  }
+  return std::unique_ptr<clang::ASTConsumer>(
+      new SuperastCPPConsumer(&Compiler.getASTContext(), handler, options));
 }
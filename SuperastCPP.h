@@ -1,3 +1,6 @@
+#ifndef CPPTRANSLATE_SUPERASTCPP_H
+#define CPPTRANSLATE_SUPERASTCPP_H
+
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Frontend/CompilerInstance.h"
@@ -5,9 +8,64 @@
 #include "clang/Tooling/Tooling.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/AST/StmtIterator.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+// Output of the translation, as a stream of JSON events
+#include "./JsonEmitter.h"
+#include "./SourcePositions.h"
+#include "./Stats.h"
 
-// RapidJson library for JSON
-#include "rapidjson/document.h"
+
+// Members with the position of each node
+enum class PositionFormat {
+  LineColumn, // "line" and "column"
+  Line,       // Only "line"
+  Offset      // Only "offset", the byte offset in the file
+};
+
+// Members written in each node, all of them by default
+struct OutputFields {
+  OutputFields()
+    : id(true), line(true), column(true), offset(true), dataType(true) {}
+
+  bool id;
+  bool line;     // Positions, if chosen by PositionFormat
+  bool column;
+  bool offset;
+  bool dataType; // The data-type and return-type of the declarations
+};
+
+// Top-level statements of a previous translation of the same file, copied
+// instead of translated again. See IncrementalReuse.
+class StatementReuse {
+public:
+  virtual ~StatementReuse() {}
+
+  // Called once the unit is parsed. Returns false if nothing can be copied.
+  virtual bool begin(clang::ASTContext& context,
+                     clang::TranslationUnitDecl* unitDecl) = 0;
+  // First id of the translated nodes, after all the copied ones
+  virtual unsigned getFirstId() const = 0;
+  // Writes the previous translation of a top-level declaration to out.
+  // Returns false if it must be translated.
+  virtual bool copy(clang::Decl* decl, JsonEmitter& out) = 0;
+};
+
+// How a translation unit is parsed and emitted
+struct SuperastCPPOptions {
+  SuperastCPPOptions()
+    : skipExternalBodies(false), streamStatements(false), checkOnly(false),
+      positions(PositionFormat::LineColumn), stats(nullptr), reuse(nullptr) {}
+
+  bool skipExternalBodies; // Do not parse function bodies out of main file
+  bool streamStatements;   // Each top-level statement is a root value
+  bool checkOnly;          // Only the array of messages, see SuperastCheck
+  PositionFormat positions;
+  OutputFields fields;
+  FileStats* stats;        // If set, times the phases and counts the nodes
+  StatementReuse* reuse;   // If set, copies the statements it can
+};
 
 
 // ******************************
@@ -16,7 +74,8 @@
 class SuperastCPP
     : public clang::RecursiveASTVisitor<SuperastCPP> {
 public:
-  explicit SuperastCPP(clang::ASTContext *context);
+  SuperastCPP(clang::ASTContext *context, JsonHandler& handler,
+              const SuperastCPPOptions& options);
 
   // STATEMENTS
   bool TraverseStmt(clang::Stmt* S);
@@ -121,43 +180,95 @@ public:
   bool TraverseCXXRecordDecl(clang::CXXRecordDecl* cxxRecordDecl);
   bool TraverseCXXMethodDecl(clang::CXXMethodDecl* D);
 
+  // The std::name<...> that type is, or null
+  static const clang::ClassTemplateSpecializationDecl* getStdSpecialization(
+      const clang::Type* type, llvm::StringRef name);
+  // If expr continues a chain of print or read operators
+  static bool isIOChain(clang::Expr* expr);
+
 private:
-  // Adds an id to the object and increments currentId;
-  void addId(rapidjson::Value& object);
-  void addLine(rapidjson::Value& object, clang::Stmt* stmt);
-  void addLine(rapidjson::Value& object, clang::Decl* decl);
-  void addCol(rapidjson::Value& object, clang::Stmt* stmt);
-  void addCol(rapidjson::Value& object, clang::Decl* decl);
-  void addPos(rapidjson::Value& object, clang::Stmt* stmt);
-  void addPos(rapidjson::Value& object, clang::Decl* decl);
-
-  // If son is not an array, will be an array containing the former one
-  void ensureSonIsArray();
-  void addElemsToArray(rapidjson::Value& parentValue,
-      rapidjson::Value& elemsValue);
-
-  rapidjson::Value createBlockValue(rapidjson::Value& arrayValue);
-  rapidjson::Value createTypeValue(const std::string& type);
-  rapidjson::Value createTypeValue(const clang::Type* type);
-  rapidjson::Value createBinOpValue(const std::string& opcode, 
-      rapidjson::Value& leftValue, rapidjson::Value& rightValue);
-  rapidjson::Value createIntegerValue(const int64_t value);
-  rapidjson::Value createFloatingValue(const double value);
-  rapidjson::Value createStringValue(const std::string& value);
-  rapidjson::Value createBoolValue(const bool value);
-  rapidjson::Value createIdentifierValue(const std::string& name);
-  bool isSTLVectorType(const clang::QualType qualType);
-  // Get vector type from string
-  rapidjson::Value createVectorValue(const clang::QualType qualType);
+  // What a type translates to, without ids
+  struct TypeInfo {
+    TypeInfo() : vectorDepth(0), unknown(false) {}
+
+    std::string name;     // Innermost type, inside the vectors
+    unsigned vectorDepth; // Vectors around it
+    bool unknown;         // name is the clang class of the type
+  };
+
+  // Adds an id to the current object and increments currentId
+  void addId();
+  // Adds an id taken before, by a node translated out of order
+  void addId(unsigned id);
+  // Adds the position where the node begins, decoded only once
+  void addPos(clang::SourceLocation loc);
+  void addPos(clang::Stmt* stmt);
+  void addPos(clang::Decl* decl);
+
+  // What TraverseStmt does before translating S. False if S is skipped.
+  bool enterStmt(clang::Stmt* S);
+  bool isTranslated(clang::Stmt* S);
+  // The node translated for stmt, under parentheses and implicit casts, or
+  // null if one of them is skipped
+  clang::Stmt* unwrapStmt(clang::Stmt* stmt);
+  // Enters the nodes from stmt down to target, without traversing them
+  void enterWrapped(clang::Stmt* stmt, clang::Stmt* target);
+
+  // Traverse a child, saying what to do with the values it emits
+  bool traverseMember(const char* key, clang::Stmt* stmt,
+                      bool optional = false);
+  bool traverseValue(clang::Stmt* stmt);
+  bool traverseValue(clang::Decl* decl);
+  bool traverseElements(clang::Stmt* stmt, bool nullIfEmpty);
+  // Only to keep the ids of the nodes after it
+  bool traverseDiscarded(clang::Stmt* stmt);
+  bool traverseDiscarded(clang::Decl* decl);
+
+  // Block object with the statements of body
+  bool traverseBlock(clang::Stmt* body);
+  void beginBlock();
+  void endBlock();
+  void beginBinaryOperator(clang::BinaryOperator* bop);
+  // Arguments of the print/read calls chained from call
+  bool traverseIOArguments(clang::CXXOperatorCallExpr* call);
+  // Emits the name of a declaration, without copying it if possible
+  void emitName(const clang::DeclarationName& name);
+  void addType(const char* key, const clang::Type* type);
+  void emitTypeValue(const std::string& type);
+  void emitTypeValue(const clang::Type* type);
+  // Starts a literal object. The caller emits the value and ends the object
+  void beginLiteralValue(const char* type);
+  // Classified once per canonical type of the translation unit
+  const TypeInfo& getTypeInfo(const clang::Type* type);
+  TypeInfo classifyType(const clang::Type* type);
+  void emitVectorValue(const TypeInfo& info);
+  // Finds cout, cin, endl... in the translation unit
+  void resolveIODecls(clang::TranslationUnitDecl* unitDecl);
   // Error and Warning
-  rapidjson::Value createMessageValue(clang::Stmt* stmt, const std::string& type,
+  void emitMessageValue(clang::Stmt* stmt, const std::string& type,
       const std::string& value, const std::string& description);
-  rapidjson::Value createMessageValue(clang::Decl* decl, const std::string& type,
+  void emitMessageValue(clang::Decl* decl, const std::string& type,
       const std::string& value, const std::string& description);
 
   clang::ASTContext *context;
+  JsonEmitter out; // Each call emits its values here
+  bool streamStatements;
+  FileStats* stats;
+  StatementReuse* reuse;
+  OutputFields fields;
+  bool writeLine;
+  bool writeColumn;
+  bool writeOffset;
+  SourcePositions positions;
+  llvm::DenseMap<const clang::Type*, TypeInfo> typeCache;
+  // Canonical declarations of the streams and of their manipulators
+  llvm::SmallPtrSet<const clang::Decl*, 4> ioObjects;
+  llvm::SmallPtrSet<const clang::Decl*, 4> ioManipulators;
+  const clang::Decl* endlDecl;
+  // Work stacks of the nodes translated without recursion
+  std::vector<std::pair<clang::BinaryOperator*, unsigned>> binaryStack;
+  std::vector<clang::CXXOperatorCallExpr*> ioStack;
   unsigned currentId;
-  rapidjson::Value sonValue; // Each call will return this
   bool iofunctionStarted; // If it is an already started chain of print function
 };
 
@@ -167,15 +278,36 @@ private:
 // ******************************
 class SuperastCPPConsumer : public clang::ASTConsumer {
 public:
-  explicit SuperastCPPConsumer(clang::ASTContext *context)
-    : Visitor(context) {}
+  SuperastCPPConsumer(clang::ASTContext *context, JsonHandler& handler,
+                      const SuperastCPPOptions& options)
+    : Visitor(context, handler, options), context(context),
+      stats(options.stats) {
+    // Created right before parsing
+    if (stats) parseStart = TimePoint::now();
+  }
 
   virtual void HandleTranslationUnit(clang::ASTContext &context) {
-    // TODO change this to skip all headers and start at begin of main file
+    if (!stats) {
+      // TODO change this to skip all headers and start at begin of main file
+      Visitor.TraverseDecl(context.getTranslationUnitDecl());
+      return;
+    }
+    const TimePoint translateStart = TimePoint::now();
+    stats->parse.add(parseStart, translateStart);
     Visitor.TraverseDecl(context.getTranslationUnitDecl());
+    stats->translate.add(translateStart, TimePoint::now());
+  }
+
+  // Only asked when the frontend is skipping function bodies. Bodies outside
+  // the main file are never translated, so there is no need to parse them.
+  virtual bool shouldSkipFunctionBody(clang::Decl* D) {
+    return !context->getSourceManager().isInMainFile(D->getLocation());
   }
 private:
   SuperastCPP Visitor;
+  clang::ASTContext *context;
+  FileStats* stats;
+  TimePoint parseStart;
 };
 
 
@@ -185,10 +317,35 @@ private:
 // ************************************************************
 class SuperastCPPAction : public clang::ASTFrontendAction {
 public:
+  SuperastCPPAction(JsonHandler& handler, const SuperastCPPOptions& options)
+    : handler(handler), options(options) {}
+
+  // A SuperastCPPConsumer, or a SuperastCheckConsumer with checkOnly
   virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
-      clang::CompilerInstance &Compiler, llvm::StringRef) {
-    return std::unique_ptr<clang::ASTConsumer>(
-        new SuperastCPPConsumer(&Compiler.getASTContext()));
+      clang::CompilerInstance &Compiler, llvm::StringRef);
+private:
+  JsonHandler& handler;
+  SuperastCPPOptions options;
+};
+
+
+// *******************************************************
+// Creates the actions that write into a given handler.
+// One factory (and one handler) for each translated file
+// *******************************************************
+class SuperastCPPActionFactory
+    : public clang::tooling::FrontendActionFactory {
+public:
+  SuperastCPPActionFactory(JsonHandler& handler,
+                           const SuperastCPPOptions& options)
+    : handler(handler), options(options) {}
+
+  virtual clang::FrontendAction* create() {
+    return new SuperastCPPAction(handler, options);
   }
+private:
+  JsonHandler& handler;
+  SuperastCPPOptions options;
 };
 
+#endif // CPPTRANSLATE_SUPERASTCPP_H
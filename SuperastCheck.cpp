@@ -0,0 +1,289 @@
+#include "./SuperastCheck.h"
+
+#include <cstring>
+
+// MACRO FOR TRAVERSING
+#define TRY_TO(CALL_EXPR)                                                      \
+do {                                                                           \
+  if (!getDerived().CALL_EXPR)                                                 \
+    return false;                                                              \
+} while (0)
+
+SuperastCheck::SuperastCheck(clang::ASTContext *context, JsonHandler& handler,
+                             const SuperastCPPOptions& options)
+    : context(context),
+      out(handler),
+      writeLine(options.fields.line &&
+                options.positions != PositionFormat::Offset),
+      writeColumn(options.fields.column &&
+                  options.positions == PositionFormat::LineColumn),
+      writeOffset(options.fields.offset &&
+                  options.positions == PositionFormat::Offset),
+      positions(context->getSourceManager()),
+      numMessages(0) {
+}
+
+bool SuperastCheck::isInMainFile(clang::SourceLocation loc) const {
+  return context->getSourceManager().isInMainFile(loc);
+}
+
+clang::Stmt* SuperastCheck::unwrapStmt(clang::Stmt* stmt) const {
+  while (stmt && isInMainFile(stmt->getLocStart())) {
+    if (auto paren = llvm::dyn_cast<clang::ParenExpr>(stmt)) {
+      stmt = paren->getSubExpr();
+    }
+    else if (auto cast = llvm::dyn_cast<clang::ImplicitCastExpr>(stmt)) {
+      stmt = cast->getSubExpr();
+    }
+    else {
+      return stmt;
+    }
+  }
+  return nullptr;
+}
+
+// Same nodes that SuperastCPP traverses: the ones of the main file
+bool SuperastCheck::TraverseStmt(clang::Stmt* S) {
+  if (!S || !isInMainFile(S->getLocStart())) return true;
+  return RecursiveASTVisitor::TraverseStmt(S);
+}
+
+bool SuperastCheck::TraverseDecl(clang::Decl* D) {
+  if (!D) return true;
+  if (auto unitDecl = llvm::dyn_cast<clang::TranslationUnitDecl>(D)) {
+    return TraverseTranslationUnitDecl(unitDecl);
+  }
+  if (!isInMainFile(D->getLocStart())) return true;
+  return RecursiveASTVisitor::TraverseDecl(D);
+}
+
+bool SuperastCheck::TraverseTranslationUnitDecl(
+    clang::TranslationUnitDecl* unitDecl) {
+  out.StartArray();
+  for (auto declaration : unitDecl->decls()) {
+    TRY_TO(TraverseDecl(declaration));
+  }
+  out.EndArray(numMessages);
+  return true;
+}
+
+bool SuperastCheck::TraverseIfStmt(clang::IfStmt* ifs) {
+  if (ifs->getConditionVariable()) {
+    addMessage(ifs->getConditionVariable()->getLocStart(), "error",
+        "condition-variable",
+        "Variable declarations are not allowed in if conditions");
+  }
+  else {
+    TRY_TO(TraverseStmt(ifs->getCond()));
+  }
+  TRY_TO(TraverseStmt(ifs->getThen()));
+  TRY_TO(TraverseStmt(ifs->getElse()));
+  return true;
+}
+
+bool SuperastCheck::TraverseWhileStmt(clang::WhileStmt* whileStmt) {
+  if (whileStmt->getConditionVariable()) {
+    addMessage(whileStmt->getConditionVariable()->getLocStart(), "error",
+        "condition-variable",
+        "Variable declarations are not allowed in while conditions");
+  }
+  else {
+    TRY_TO(TraverseStmt(whileStmt->getCond()));
+  }
+  TRY_TO(TraverseStmt(whileStmt->getBody()));
+  return true;
+}
+
+bool SuperastCheck::TraverseForStmt(clang::ForStmt* forStmt) {
+  // A group of declarations is left out of the translation
+  clang::DeclStmt* declStmt =
+      llvm::dyn_cast_or_null<clang::DeclStmt>(forStmt->getInit());
+  if (declStmt && !declStmt->isSingleDecl()) {
+    addMessage(forStmt->getLocStart(), "error", "compoundStmt",
+        "Compound Statements are not allowed in for loop init");
+  }
+  else {
+    TRY_TO(TraverseStmt(forStmt->getInit()));
+  }
+  TRY_TO(TraverseStmt(forStmt->getCond()));
+  TRY_TO(TraverseStmt(forStmt->getInc()));
+  TRY_TO(TraverseStmt(forStmt->getBody()));
+  return true;
+}
+
+// Print and read chains, without their stream, and operator []. The
+// arguments of other operators are not translated.
+bool SuperastCheck::TraverseCXXOperatorCallExpr(
+    clang::CXXOperatorCallExpr* call) {
+  auto decl =
+      llvm::dyn_cast_or_null<clang::FunctionDecl>(call->getCalleeDecl());
+  if (!decl) return true;
+  const clang::OverloadedOperatorKind op = decl->getOverloadedOperator();
+  if (op == clang::OO_Subscript) {
+    TRY_TO(TraverseStmt(call->getArg(0)));
+    TRY_TO(TraverseStmt(call->getArg(1)));
+    return true;
+  }
+  if (op != clang::OO_LessLess && op != clang::OO_GreaterGreater) return true;
+
+  // Walked down as SuperastCPP does, so long chains take no native stack
+  const size_t base = ioStack.size();
+  ioStack.push_back(call);
+  bool result = true;
+  while (true) {
+    clang::Expr* first = ioStack.back()->getArg(0);
+    if (!SuperastCPP::isIOChain(first)) break;
+    auto nested =
+        llvm::dyn_cast_or_null<clang::CXXOperatorCallExpr>(unwrapStmt(first));
+    if (!nested) {
+      result = TraverseStmt(first);
+      break;
+    }
+    ioStack.push_back(nested);
+  }
+  while (ioStack.size() > base) {
+    clang::CXXOperatorCallExpr* current = ioStack.back();
+    ioStack.pop_back();
+    for (unsigned i = 1; result && i < current->getNumArgs(); ++i) {
+      result = TraverseStmt(current->getArg(i));
+    }
+  }
+  return result;
+}
+
+// The arguments are translated before the object
+bool SuperastCheck::TraverseCXXMemberCallExpr(
+    clang::CXXMemberCallExpr* memberCall) {
+  for (auto arg : memberCall->arguments()) {
+    TRY_TO(TraverseStmt(arg));
+  }
+  clang::Expr* objectExpr = memberCall->getImplicitObjectArgument();
+  if (auto implicitExpr = llvm::dyn_cast<clang::ImplicitCastExpr>(objectExpr)) {
+    objectExpr = implicitExpr->getSubExpr();
+  }
+  return TraverseStmt(objectExpr);
+}
+
+// Only the base is translated, the declaration of the member is discarded
+bool SuperastCheck::TraverseMemberExpr(clang::MemberExpr* memberExpr) {
+  return TraverseStmt(memberExpr->getBase());
+}
+
+bool SuperastCheck::TraverseDeclRefExpr(clang::DeclRefExpr*) {
+  return true;
+}
+
+// Calls of something else than a function are not translated
+bool SuperastCheck::TraverseCallExpr(clang::CallExpr* call) {
+  if (!llvm::dyn_cast_or_null<clang::FunctionDecl>(call->getCalleeDecl())) {
+    return true;
+  }
+  for (auto arg : call->arguments()) {
+    TRY_TO(TraverseStmt(arg));
+  }
+  return true;
+}
+
+bool SuperastCheck::TraverseFunctionDecl(clang::FunctionDecl* functionDecl) {
+  for (unsigned int i = 0; i < functionDecl->param_size(); ++i) {
+    TRY_TO(TraverseDecl(functionDecl->getParamDecl(i)));
+  }
+  if (functionDecl->isThisDeclarationADefinition()) {
+    TRY_TO(TraverseStmt(functionDecl->getBody()));
+  }
+  return true;
+}
+
+// The initializer of structs, vectors and initializer lists is not translated
+bool SuperastCheck::TraverseVarDecl(clang::VarDecl* var) {
+  const clang::Type* type =
+      var->getType().getNonLValueExprType(*context).getTypePtr();
+  if (!var->hasInit() || type->isStructureType() ||
+      var->getInitStyle() == clang::VarDecl::ListInit ||
+      SuperastCPP::getStdSpecialization(
+          type->getCanonicalTypeInternal().getTypePtr(), "vector")) {
+    return true;
+  }
+  return TraverseStmt(var->getInit());
+}
+
+bool SuperastCheck::TraverseParmVarDecl(clang::ParmVarDecl* parmVarDecl) {
+  return TraverseVarDecl(parmVarDecl);
+}
+
+bool SuperastCheck::TraverseFieldDecl(clang::FieldDecl*) {
+  return true;
+}
+
+bool SuperastCheck::TraverseCXXRecordDecl(
+    clang::CXXRecordDecl* cxxRecordDecl) {
+  if (cxxRecordDecl->isImplicit()) return true;
+  return RecursiveASTVisitor::TraverseCXXRecordDecl(cxxRecordDecl);
+}
+
+// Methods declaration. Not translated
+bool SuperastCheck::TraverseCXXMethodDecl(clang::CXXMethodDecl*) {
+  return true;
+}
+
+bool SuperastCheck::TraverseDoStmt(clang::DoStmt* doStmt) {
+  addMessage(doStmt->getLocStart(), "error", "do/while statement",
+      "Do/While statements are not allowed");
+  return true;
+}
+
+bool SuperastCheck::TraverseBinComma(clang::BinaryOperator* bop) {
+  addMessage(bop->getLocStart(), "warning", "comma operator",
+      "We recommend not using the comma operator!");
+  return true;
+}
+
+bool SuperastCheck::TraverseBreakStmt(clang::BreakStmt* breakStmt) {
+  addMessage(breakStmt->getLocStart(), "error", "break statement",
+      "Breaks are not allowed");
+  return true;
+}
+
+bool SuperastCheck::TraverseLabelStmt(clang::LabelStmt* labelStmt) {
+  addMessage(labelStmt->getLocStart(), "error", "label",
+      "Labels are not allowed");
+  return true;
+}
+
+bool SuperastCheck::TraverseGotoStmt(clang::GotoStmt* gotoStmt) {
+  addMessage(gotoStmt->getLocStart(), "error", "goto",
+      "Goto is not allowed");
+  return true;
+}
+
+void SuperastCheck::addMessage(clang::SourceLocation loc, const char* type,
+                               const char* value, const char* description) {
+  out.StartObject();
+  rapidjson::SizeType members = 3;
+  if (writeLine || writeColumn || writeOffset) {
+    const SourcePositions::Position position = positions.get(loc);
+    if (writeLine) {
+      out.Key("line", 4, false);
+      out.Int(position.line);
+      ++members;
+    }
+    if (writeColumn) {
+      out.Key("column", 6, false);
+      out.Int(position.column);
+      ++members;
+    }
+    if (writeOffset) {
+      out.Key("offset", 6, false);
+      out.Int(position.offset);
+      ++members;
+    }
+  }
+  out.Key("type", 4, false);
+  out.String(type, std::strlen(type), false);
+  out.Key("value", 5, false);
+  out.String(value, std::strlen(value), false);
+  out.Key("description", 11, false);
+  out.String(description, std::strlen(description), false);
+  out.EndObject(members);
+  ++numMessages;
+}
@@ -0,0 +1,106 @@
+#ifndef CPPTRANSLATE_SUPERASTCHECK_H
+#define CPPTRANSLATE_SUPERASTCHECK_H
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+
+#include "./JsonEmitter.h"
+#include "./SourcePositions.h"
+#include "./SuperastCPP.h"
+
+#include <vector>
+
+// ******************************************************************
+// Finds the constructs SuperastCPP translates into error or warning
+// messages, without translating anything. The messages are written
+// as a single array, each one as SuperastCPP writes it but without id.
+// Only the children SuperastCPP translates are visited.
+// ******************************************************************
+class SuperastCheck
+    : public clang::RecursiveASTVisitor<SuperastCheck> {
+public:
+  SuperastCheck(clang::ASTContext *context, JsonHandler& handler,
+                const SuperastCPPOptions& options);
+
+  bool TraverseStmt(clang::Stmt* S);
+  bool TraverseDecl(clang::Decl* D);
+  bool TraverseTranslationUnitDecl(clang::TranslationUnitDecl* unitDecl);
+
+  // Only what SuperastCPP translates of them is checked
+  bool TraverseIfStmt(clang::IfStmt* ifs);
+  bool TraverseWhileStmt(clang::WhileStmt* whileStmt);
+  bool TraverseForStmt(clang::ForStmt* forStmt);
+  bool TraverseCXXOperatorCallExpr(clang::CXXOperatorCallExpr* call);
+  bool TraverseCXXMemberCallExpr(clang::CXXMemberCallExpr* memberCall);
+  bool TraverseMemberExpr(clang::MemberExpr* memberExpr);
+  bool TraverseDeclRefExpr(clang::DeclRefExpr* declRefExpr);
+  bool TraverseCallExpr(clang::CallExpr* call);
+  bool TraverseFunctionDecl(clang::FunctionDecl* functionDecl);
+  bool TraverseVarDecl(clang::VarDecl* var);
+  bool TraverseParmVarDecl(clang::ParmVarDecl* parmVarDecl);
+  bool TraverseFieldDecl(clang::FieldDecl* fieldDecl);
+  bool TraverseCXXRecordDecl(clang::CXXRecordDecl* cxxRecordDecl);
+  bool TraverseCXXMethodDecl(clang::CXXMethodDecl* D);
+
+  // NOT SUPPORTED, their children are not translated either
+  bool TraverseDoStmt(clang::DoStmt* doStmt);
+  bool TraverseBinComma(clang::BinaryOperator* bop);
+  bool TraverseBreakStmt(clang::BreakStmt* breakStmt);
+  bool TraverseLabelStmt(clang::LabelStmt* labelStmt);
+  bool TraverseGotoStmt(clang::GotoStmt* gotoStmt);
+
+private:
+  bool isInMainFile(clang::SourceLocation loc) const;
+  // The node under parentheses and implicit casts, or null if one of them
+  // is skipped
+  clang::Stmt* unwrapStmt(clang::Stmt* stmt) const;
+  void addMessage(clang::SourceLocation loc, const char* type,
+                  const char* value, const char* description);
+
+  clang::ASTContext *context;
+  JsonHandler& out;
+  bool writeLine;
+  bool writeColumn;
+  bool writeOffset;
+  SourcePositions positions;
+  unsigned numMessages;
+  std::vector<clang::CXXOperatorCallExpr*> ioStack;
+};
+
+
+// ********************************************
+// Interface to read from the AST, as the one of
+// SuperastCPP but only checking it
+// ********************************************
+class SuperastCheckConsumer : public clang::ASTConsumer {
+public:
+  SuperastCheckConsumer(clang::ASTContext *context, JsonHandler& handler,
+                        const SuperastCPPOptions& options)
+    : Visitor(context, handler, options), context(context),
+      stats(options.stats) {
+    if (stats) parseStart = TimePoint::now();
+  }
+
+  virtual void HandleTranslationUnit(clang::ASTContext &context) {
+    if (!stats) {
+      Visitor.TraverseDecl(context.getTranslationUnitDecl());
+      return;
+    }
+    const TimePoint checkStart = TimePoint::now();
+    stats->parse.add(parseStart, checkStart);
+    Visitor.TraverseDecl(context.getTranslationUnitDecl());
+    stats->translate.add(checkStart, TimePoint::now());
+  }
+
+  // Bodies outside the main file are never checked
+  virtual bool shouldSkipFunctionBody(clang::Decl* D) {
+    return !context->getSourceManager().isInMainFile(D->getLocation());
+  }
+private:
+  SuperastCheck Visitor;
+  clang::ASTContext *context;
+  FileStats* stats;
+  TimePoint parseStart;
+};
+
+#endif // CPPTRANSLATE_SUPERASTCHECK_H
@@ -0,0 +1,694 @@
+#include "./Translator.h"
+#include "./Incremental.h"
+#include "./MsgPackWriter.h"
+#include "./PreambleCache.h"
+#include "./ResultCache.h"
+#include "./Stats.h"
+#include "./SuperastCPP.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+std::vector<std::string> getCompileFlags(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path) {
+  std::vector<std::string> flags;
+  std::vector<clang::tooling::CompileCommand> commands =
+      compilations.getCompileCommands(path);
+  if (!commands.empty()) {
+    const std::vector<std::string>& commandLine = commands.front().CommandLine;
+    for (size_t i = 1; i < commandLine.size(); ++i) {
+      if (commandLine[i] != path) flags.push_back(commandLine[i]);
+    }
+  }
+  return flags;
+}
+
+std::vector<std::string> getFileFlags(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options) {
+  std::vector<std::string> flags = getCompileFlags(compilations, path);
+  flags.insert(flags.end(), options.flags.begin(), options.flags.end());
+  return flags;
+}
+
+// Precompiled preamble to parse source with, empty if there is none
+static std::string getPreamblePCH(const TranslationOptions& options,
+                                  llvm::StringRef source,
+                                  const std::vector<std::string>& flags) {
+  if (!options.preambleCache) return "";
+  return options.preambleCache->getPCH(source, flags);
+}
+
+// Forwards the events to another handler, noting if there was any
+class EmittedHandler : public JsonHandler {
+public:
+  explicit EmittedHandler(JsonHandler& handler)
+    : handler(handler), emitted(false) {}
+
+  virtual bool Null() { emitted = true; return handler.Null(); }
+  virtual bool Bool(bool b) { emitted = true; return handler.Bool(b); }
+  virtual bool Int(int i) { emitted = true; return handler.Int(i); }
+  virtual bool Uint(unsigned u) { emitted = true; return handler.Uint(u); }
+  virtual bool Int64(int64_t i) { emitted = true; return handler.Int64(i); }
+  virtual bool Uint64(uint64_t u) {
+    emitted = true;
+    return handler.Uint64(u);
+  }
+  virtual bool Double(double d) { emitted = true; return handler.Double(d); }
+  virtual bool String(const char* str, rapidjson::SizeType length,
+                      bool copy) {
+    emitted = true;
+    return handler.String(str, length, copy);
+  }
+  virtual bool StartObject() { emitted = true; return handler.StartObject(); }
+  virtual bool Key(const char* str, rapidjson::SizeType length, bool copy) {
+    return handler.Key(str, length, copy);
+  }
+  virtual bool EndObject(rapidjson::SizeType memberCount) {
+    return handler.EndObject(memberCount);
+  }
+  virtual bool StartArray() { emitted = true; return handler.StartArray(); }
+  virtual bool EndArray(rapidjson::SizeType elementCount) {
+    return handler.EndArray(elementCount);
+  }
+
+  JsonHandler& handler;
+  bool emitted;
+};
+
+// Translates path, parsing it with pch if it is not empty
+static int runTranslation(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, JsonHandler& handler,
+    const TranslationOptions& options, const std::string& pch) {
+  clang::tooling::ClangTool tool(compilations, path);
+
+  if (!pch.empty()) {
+    tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster(
+        {"-include-pch", pch}, clang::tooling::ArgumentInsertPosition::BEGIN));
+  }
+
+  if (!options.flags.empty()) {
+    tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster(
+        options.flags, clang::tooling::ArgumentInsertPosition::END));
+  }
+
+  if (!options.stats) {
+    SuperastCPPActionFactory factory(handler, options.visitor);
+    return tool.run(&factory);
+  }
+
+  FileStats stats;
+  SuperastCPPOptions visitorOptions = options.visitor;
+  visitorOptions.stats = &stats;
+  SuperastCPPActionFactory factory(handler, visitorOptions);
+  const int status = tool.run(&factory);
+  options.stats->add(stats);
+  return status;
+}
+
+int translateFile(const clang::tooling::CompilationDatabase& compilations,
+                  const std::string& path, JsonHandler& handler,
+                  const TranslationOptions& options) {
+  std::string pch;
+  if (options.preambleCache) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> source =
+        llvm::MemoryBuffer::getFile(path);
+    if (source) {
+      pch = getPreamblePCH(options, (*source)->getBuffer(),
+                           getFileFlags(compilations, path, options));
+    }
+  }
+  if (pch.empty()) {
+    return runTranslation(compilations, path, handler, options, "");
+  }
+
+  // Clang rejects a pch whose headers changed since it was built, before
+  // anything is translated. The file is then translated without it, and the
+  // pch is built again for the next one.
+  EmittedHandler checkedHandler(handler);
+  const int status =
+      runTranslation(compilations, path, checkedHandler, options, pch);
+  if (status == 0 || checkedHandler.emitted) return status;
+  const int retriedStatus =
+      runTranslation(compilations, path, handler, options, "");
+  if (retriedStatus == 0) options.preambleCache->invalidate(pch);
+  return retriedStatus;
+}
+
+// Size of the buffer used to write straight to the output file
+static const size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+// Lines of ndjson are always compact
+static bool isPretty(const TranslationOptions& options) {
+  return options.format == OutputFormat::Pretty && !options.ndjson;
+}
+
+// Writes the translation of path with a Writer, a PrettyWriter or a
+// MsgPackWriter
+template <typename Writer>
+static int writeTranslation(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    Writer& writer) {
+  JsonHandlerAdapter<Writer> handler(writer);
+  const int status = translateFile(compilations, path, handler, options);
+  // Nothing was translated, as a document that was never set
+  if (!writer.IsComplete()) writer.Null();
+  return status;
+}
+
+// Writes the translation of path to stream in the chosen format. Json is
+// followed by a newline, MessagePack values need no separator.
+template <typename OutputStream>
+static int writeTranslationTo(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    OutputStream& stream) {
+  if (options.format == OutputFormat::MsgPack) {
+    MsgPackWriter<OutputStream> writer(stream);
+    return writeTranslation(compilations, path, options, writer);
+  }
+
+  int status;
+  if (isPretty(options)) {
+    rapidjson::PrettyWriter<OutputStream> writer(stream);
+    status = writeTranslation(compilations, path, options, writer);
+  }
+  else {
+    rapidjson::Writer<OutputStream> writer(stream);
+    status = writeTranslation(compilations, path, options, writer);
+  }
+  stream.Put('\n');
+  return status;
+}
+
+// Appends to a string, as a rapidjson output stream
+class StringAppendStream {
+public:
+  typedef char Ch;
+
+  explicit StringAppendStream(std::string& string) : string(string) {}
+
+  void Put(char c) { string.push_back(c); }
+  void Flush() {}
+
+private:
+  std::string& string;
+};
+
+void appendJsonRecord(const std::string& path, llvm::StringRef json,
+                      std::string& record) {
+  record += "{\"file\":";
+  // The writer is only used to escape the path
+  StringAppendStream stream(record);
+  rapidjson::Writer<StringAppendStream> writer(stream);
+  writer.String(path.c_str(), path.size());
+  record += ",\"ast\":";
+  json = json.rtrim("\n");
+  record.append(json.data(), json.size());
+  record += "}\n";
+}
+
+std::string dumpJsonRecord(const std::string& path, llvm::StringRef json) {
+  std::string record;
+  appendJsonRecord(path, json, record);
+  return record;
+}
+
+void appendMsgPackRecord(const std::string& path, llvm::StringRef msgpack,
+                         std::string& record) {
+  // The map 32 header of MsgPackWriter, with two entries
+  record.append("\xdf\0\0\0\x02", 5);
+  appendMsgPackString(record, "file", 4);
+  appendMsgPackString(record, path.c_str(), path.size());
+  appendMsgPackString(record, "ast", 3);
+  record.append(msgpack.data(), msgpack.size());
+}
+
+// Describes the visitor options that change the translated tree
+static std::string getVisitorConfig(const SuperastCPPOptions& visitor) {
+  std::string config;
+  if (visitor.checkOnly) config += ",check";
+  if (visitor.positions == PositionFormat::Line) config += ",line";
+  else if (visitor.positions == PositionFormat::Offset) config += ",offset";
+  const OutputFields& fields = visitor.fields;
+  if (!fields.id) config += ",-id";
+  if (!fields.line) config += ",-line";
+  if (!fields.column) config += ",-column";
+  if (!fields.offset) config += ",-offset";
+  if (!fields.dataType) config += ",-data-type";
+  return config;
+}
+
+std::string getOutputConfig(const TranslationOptions& options) {
+  std::string config;
+  if (options.format == OutputFormat::MsgPack) config = "msgpack";
+  else config = isPretty(options) ? "pretty" : "compact";
+  return config + getVisitorConfig(options.visitor);
+}
+
+// Translates the file into the buffer of arena, or copies it there from the
+// cache. output points to the buffer, until arena.end().
+static int translateFileToJson(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    OutputArena& arena, llvm::StringRef& output) {
+  rapidjson::StringBuffer& buffer = arena.begin();
+  std::string key;
+  if (options.resultCache) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> source =
+        llvm::MemoryBuffer::getFile(path);
+    if (source) {
+      key = options.resultCache->getKey((*source)->getBuffer(),
+                                        getFileFlags(compilations, path, options),
+                                        getOutputConfig(options));
+    }
+    std::string cached;
+    if (!key.empty() && options.resultCache->lookup(key, cached)) {
+      std::memcpy(buffer.Push(cached.size()), cached.data(), cached.size());
+      output = llvm::StringRef(buffer.GetString(), buffer.GetSize());
+      return 0;
+    }
+  }
+
+  const int status = writeTranslationTo(compilations, path, options, buffer);
+  output = llvm::StringRef(buffer.GetString(), buffer.GetSize());
+
+  // Failed translations are always repeated, to show their errors
+  if (status == 0 && !key.empty()) options.resultCache->store(key, output);
+  return status;
+}
+
+// Counts the bytes written to another stream, only used with -stats
+template <typename OutputStream>
+class CountingStream {
+public:
+  typedef typename OutputStream::Ch Ch;
+
+  explicit CountingStream(OutputStream& stream) : stream(stream), count(0) {}
+
+  void Put(Ch c) {
+    stream.Put(c);
+    ++count;
+  }
+  void Flush() { stream.Flush(); }
+
+  OutputStream& stream;
+  uint64_t count;
+};
+
+// Translates the file straight to out, through a buffer of fixed size, so
+// the output is never kept in memory
+static int translateFileToOutput(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    std::FILE* out) {
+  std::vector<char> buffer(OUTPUT_BUFFER_SIZE);
+  rapidjson::FileWriteStream stream(out, buffer.data(), buffer.size());
+  int status;
+  if (options.stats) {
+    CountingStream<rapidjson::FileWriteStream> countingStream(stream);
+    status = writeTranslationTo(compilations, path, options, countingStream);
+    options.stats->addOutput(countingStream.count, buffer.size());
+  }
+  else {
+    status = writeTranslationTo(compilations, path, options, stream);
+  }
+  stream.Flush();
+  std::fflush(out);
+  return status;
+}
+
+// Writes each root value it receives as a record keyed by path, as soon as
+// the value is finished. Json records end with a newline.
+template <typename Writer>
+class StatementLineHandler : public JsonHandler {
+public:
+  StatementLineHandler(const std::string& path, bool newline,
+                       const std::function<void(const char*, size_t)>& write)
+    : path(path), newline(newline), write(write), writer(buffer), depth(0) {}
+
+  virtual bool Null() { beginLine(); writer.Null(); return endLine(); }
+  virtual bool Bool(bool b) { beginLine(); writer.Bool(b); return endLine(); }
+  virtual bool Int(int i) { beginLine(); writer.Int(i); return endLine(); }
+  virtual bool Uint(unsigned u) {
+    beginLine();
+    writer.Uint(u);
+    return endLine();
+  }
+  virtual bool Int64(int64_t i) {
+    beginLine();
+    writer.Int64(i);
+    return endLine();
+  }
+  virtual bool Uint64(uint64_t u) {
+    beginLine();
+    writer.Uint64(u);
+    return endLine();
+  }
+  virtual bool Double(double d) {
+    beginLine();
+    writer.Double(d);
+    return endLine();
+  }
+  virtual bool String(const char* str, rapidjson::SizeType length,
+                      bool copy) {
+    beginLine();
+    writer.String(str, length, copy);
+    return endLine();
+  }
+  virtual bool StartObject() {
+    beginLine();
+    ++depth;
+    return writer.StartObject();
+  }
+  virtual bool Key(const char* str, rapidjson::SizeType length, bool copy) {
+    return writer.Key(str, length, copy);
+  }
+  virtual bool EndObject(rapidjson::SizeType memberCount) {
+    writer.EndObject(memberCount);
+    --depth;
+    return endLine();
+  }
+  virtual bool StartArray() {
+    beginLine();
+    ++depth;
+    return writer.StartArray();
+  }
+  virtual bool EndArray(rapidjson::SizeType elementCount) {
+    writer.EndArray(elementCount);
+    --depth;
+    return endLine();
+  }
+
+private:
+  // Called before a value. A root value starts a new line
+  void beginLine() {
+    if (depth > 0) return;
+    buffer.Clear();
+    writer.Reset(buffer);
+    writer.StartObject();
+    writer.Key("file");
+    writer.String(path.c_str(), path.size());
+    writer.Key("statement");
+  }
+
+  // Called after a value. A root value ends its line
+  bool endLine() {
+    if (depth > 0) return true;
+    writer.EndObject();
+    if (newline) buffer.Put('\n');
+    write(buffer.GetString(), buffer.GetSize());
+    return true;
+  }
+
+  const std::string& path;
+  bool newline;
+  std::function<void(const char*, size_t)> write;
+  rapidjson::StringBuffer buffer;
+  Writer writer;
+  unsigned depth; // Open objects and arrays of the current statement
+};
+
+// Translates the file handing each top-level statement to `write` as soon as
+// it is translated, as a record keyed by the path
+static int translateFileStreaming(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    const std::function<void(const char*, size_t)>& write) {
+  if (options.format == OutputFormat::MsgPack) {
+    StatementLineHandler<MsgPackWriter<rapidjson::StringBuffer>> handler(
+        path, false, write);
+    return translateFile(compilations, path, handler, options);
+  }
+  StatementLineHandler<rapidjson::Writer<rapidjson::StringBuffer>> handler(
+      path, true, write);
+  return translateFile(compilations, path, handler, options);
+}
+
+int translateFileToString(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    OutputArena& arena, std::string& output) {
+  llvm::StringRef json;
+  const int status =
+      translateFileToJson(compilations, path, options, arena, json);
+  output.clear();
+  if (!options.ndjson) {
+    output.append(json.data(), json.size());
+  }
+  else if (options.format == OutputFormat::MsgPack) {
+    appendMsgPackRecord(path, json, output);
+  }
+  else {
+    appendJsonRecord(path, json, output);
+  }
+  arena.end();
+  return status;
+}
+
+int translateFiles(const clang::tooling::CompilationDatabase& compilations,
+                   const std::vector<std::string>& paths,
+                   const TranslationOptions& options, std::FILE* out) {
+  const size_t numFiles = paths.size();
+  unsigned jobs = options.jobs;
+  if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+  jobs = std::min<size_t>(jobs, std::max<size_t>(numFiles, 1));
+
+  // Each file gets its own writer, and the buffer of the thread's arena. The
+  // strings of result are reused.
+  auto translate = [&](size_t i, OutputArena& arena,
+                       TranslationResult& result) {
+    result.path = paths[i];
+    result.output.clear();
+    if (options.visitor.streamStatements) {
+      // Straight to the output if there are no other files in progress
+      result.status = translateFileStreaming(compilations, paths[i], options,
+          [&](const char* line, size_t size) {
+            if (jobs == 1) {
+              std::fwrite(line, 1, size, out);
+              if (options.stats) options.stats->addOutput(size, size);
+            }
+            else {
+              result.output.append(line, size);
+            }
+          });
+      return;
+    }
+    result.status = translateFileToString(compilations, paths[i], options,
+                                          arena, result.output);
+  };
+
+  auto emit = [&](const TranslationResult& result) {
+    std::fwrite(result.output.data(), 1, result.output.size(), out);
+    std::fflush(out);
+    if (options.stats) {
+      options.stats->addOutput(result.output.size(), result.output.size());
+    }
+  };
+
+  int returnValue = 0;
+
+  // Sequential, no need for threads
+  if (jobs == 1) {
+    OutputArena arena;
+    TranslationResult result;
+    for (size_t i = 0; i < numFiles; ++i) {
+      // Nothing to wrap or to store in the cache, write as it is translated
+      if (!options.ndjson && !options.visitor.streamStatements &&
+          !options.resultCache) {
+        const int status =
+            translateFileToOutput(compilations, paths[i], options, out);
+        returnValue = std::max(returnValue, status);
+        continue;
+      }
+      translate(i, arena, result);
+      returnValue = std::max(returnValue, result.status);
+      emit(result);
+    }
+    return returnValue;
+  }
+
+  // Workers take the next file, and the calling thread emits in input order.
+  // Emitted results go back to spare, so their strings are reused.
+  std::vector<TranslationResult> results(numFiles);
+  std::vector<bool> finished(numFiles, false);
+  std::vector<TranslationResult> spare;
+  std::mutex mutex;
+  std::condition_variable resultReady;
+  std::atomic<size_t> nextFile(0);
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < jobs; ++i) {
+    workers.emplace_back([&]() {
+      OutputArena arena;
+      for (size_t file = nextFile++; file < numFiles; file = nextFile++) {
+        TranslationResult result;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!spare.empty()) {
+            result = std::move(spare.back());
+            spare.pop_back();
+          }
+        }
+        translate(file, arena, result);
+        std::lock_guard<std::mutex> lock(mutex);
+        results[file] = std::move(result);
+        finished[file] = true;
+        resultReady.notify_all();
+      }
+    });
+  }
+
+  for (size_t i = 0; i < numFiles; ++i) {
+    TranslationResult result;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      resultReady.wait(lock, [&]() { return finished[i]; });
+      result = std::move(results[i]);
+    }
+    returnValue = std::max(returnValue, result.status);
+    emit(result);
+    std::lock_guard<std::mutex> lock(mutex);
+    spare.push_back(std::move(result));
+  }
+
+  for (std::thread& worker : workers) worker.join();
+  return returnValue;
+}
+
+// Sources mapped into the same FileManager
+static const unsigned MAX_MAPPED_SOURCES = 1024;
+
+SourceTranslator::SourceTranslator(
+    const clang::tooling::CompilationDatabase& compilations,
+    const TranslationOptions& options)
+    : compilations(compilations),
+      options(options),
+      files(new clang::FileManager(clang::FileSystemOptions())),
+      buffer(),
+      writer(buffer),
+      handler(writer),
+      visitorOptions(options.visitor),
+      numTranslations(0) {
+  // Each request gets a single reply
+  visitorOptions.streamStatements = false;
+  factory.reset(new SuperastCPPActionFactory(handler, visitorOptions));
+}
+
+SourceTranslator::~SourceTranslator() {
+}
+
+int SourceTranslator::translate(const std::string& name,
+                                const std::string& source,
+                                const std::vector<std::string>& flags) {
+  return run(name, source, flags, *factory);
+}
+
+int SourceTranslator::translateIncremental(
+    const std::string& name, const std::string& source,
+    const std::vector<std::string>& flags,
+    const PreviousTranslation& previous) {
+  IncrementalReuse reuse(previous.source, previous.output, source,
+                         visitorOptions);
+  SuperastCPPOptions incrementalOptions = visitorOptions;
+  incrementalOptions.reuse = &reuse;
+  SuperastCPPActionFactory incrementalFactory(handler, incrementalOptions);
+  return run(name, source, flags, incrementalFactory);
+}
+
+int SourceTranslator::run(const std::string& name, const std::string& source,
+                          const std::vector<std::string>& flags,
+                          clang::tooling::ToolAction& action) {
+  // The FileManager caches its entries by name, so every source is mapped to a
+  // path of its own. It keeps all of them, so it is started again now and
+  // then for a long running server.
+  if (numTranslations == MAX_MAPPED_SOURCES) {
+    files.reset(new clang::FileManager(clang::FileSystemOptions()));
+    numTranslations = 0;
+  }
+  const std::string path = "/cpptranslate/" +
+      std::to_string(numTranslations++) + "/" +
+      llvm::sys::path::filename(name).str();
+
+  // Same flags that ClangTool would use for this file, plus the given ones
+  std::vector<std::string> allFlags = getFileFlags(compilations, name, options);
+  allFlags.insert(allFlags.end(), flags.begin(), flags.end());
+
+  // As in translateFile, a rejected pch fails before anything is written
+  const std::string pch = getPreamblePCH(options, source, allFlags);
+  int status = invoke(path, source, allFlags, pch, action);
+  if (status != 0 && !pch.empty() && buffer.GetSize() == 0) {
+    status = invoke(path, source, allFlags, "", action);
+    if (status == 0) options.preambleCache->invalidate(pch);
+  }
+  // Nothing was translated, as a document that was never set
+  if (!writer.IsComplete()) writer.Null();
+  return status;
+}
+
+int SourceTranslator::invoke(const std::string& path,
+                             const std::string& source,
+                             const std::vector<std::string>& flags,
+                             const std::string& pch,
+                             clang::tooling::ToolAction& action) {
+  std::vector<std::string> commandLine = {"clang-tool"};
+  if (!pch.empty()) {
+    commandLine.push_back("-include-pch");
+    commandLine.push_back(pch);
+  }
+  commandLine.insert(commandLine.end(), flags.begin(), flags.end());
+  commandLine = clang::tooling::getClangStripOutputAdjuster()(commandLine, path);
+  commandLine = clang::tooling::getClangSyntaxOnlyAdjuster()(commandLine, path);
+  commandLine.push_back(path);
+
+  buffer.Clear();
+  writer.Reset(buffer);
+  clang::tooling::ToolInvocation invocation(commandLine, &action, files.get());
+  invocation.mapVirtualFile(path, source);
+  return invocation.run() ? 0 : 1;
+}
+
+int SourceTranslator::translateToString(const std::string& name,
+                                        const std::string& source,
+                                        const std::vector<std::string>& flags,
+                                        std::string& output,
+                                        const PreviousTranslation* previous) {
+  // The ids of the previous translation would not come from the cache
+  if (previous) {
+    const int status = translateIncremental(name, source, flags, *previous);
+    output = getOutput().str();
+    output += '\n';
+    return status;
+  }
+
+  std::string key;
+  if (options.resultCache) {
+    std::vector<std::string> allFlags =
+        getFileFlags(compilations, name, options);
+    allFlags.insert(allFlags.end(), flags.begin(), flags.end());
+    key = options.resultCache->getKey(
+        source, allFlags, "compact" + getVisitorConfig(options.visitor));
+  }
+  if (!key.empty() && options.resultCache->lookup(key, output)) return 0;
+
+  const int status = translate(name, source, flags);
+  output = getOutput().str();
+  output += '\n';
+  if (status == 0 && !key.empty()) options.resultCache->store(key, output);
+  return status;
+}
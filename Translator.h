@@ -0,0 +1,163 @@
+#ifndef CPPTRANSLATE_TRANSLATOR_H
+#define CPPTRANSLATE_TRANSLATOR_H
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include "./OutputArena.h"
+#include "./SuperastCPP.h"
+
+// RapidJson library for JSON
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+class PreambleCache;
+class ResultCache;
+class RunStats;
+
+// How each translated file is written
+enum class OutputFormat {
+  Compact, // A single line
+  Pretty,  // Indented
+  MsgPack  // MessagePack, with the same schema
+};
+
+// Settings shared by all the translations of a run
+struct TranslationOptions {
+  TranslationOptions()
+    : jobs(1), ndjson(false), format(OutputFormat::Compact),
+      preambleCache(nullptr), resultCache(nullptr), stats(nullptr) {}
+
+  unsigned jobs; // Files translated in parallel, 0 for one per core
+  bool ndjson;   // One record keyed by path for each file, never indented
+  OutputFormat format;
+  PreambleCache* preambleCache; // If set, parse with precompiled preambles
+  ResultCache* resultCache;     // If set, reuse the output of equal sources
+  RunStats* stats;              // If set, collect statistics of every file
+  std::vector<std::string> flags; // Appended to the compile flags of each file
+  // With streamStatements, one line for each top-level statement, as it is
+  // translated
+  SuperastCPPOptions visitor;
+};
+
+// Result of translating one source file
+struct TranslationResult {
+  std::string path;
+  std::string output; // Serialized translation, json ends with a newline
+  int status;         // Same meaning as the value returned by ClangTool::run
+};
+
+// Flags of the compile command of path, without the program and the file
+std::vector<std::string> getCompileFlags(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path);
+
+// Flags of the compile command of path, plus the ones of options
+std::vector<std::string> getFileFlags(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options);
+
+// Translates a single source file, writing it to handler as it is traversed.
+// Each call uses its own ClangTool, so calls with different handlers can run
+// in parallel.
+int translateFile(const clang::tooling::CompilationDatabase& compilations,
+                  const std::string& path, JsonHandler& handler,
+                  const TranslationOptions& options);
+
+// Appends to record a dumped json document, wrapped in a single line object
+// keyed by its path
+void appendJsonRecord(const std::string& path, llvm::StringRef json,
+                      std::string& record);
+
+// Like appendJsonRecord, returning the record
+std::string dumpJsonRecord(const std::string& path, llvm::StringRef json);
+
+// Appends to record a MessagePack value, wrapped in a map
+// {"file": path, "ast": value}
+void appendMsgPackRecord(const std::string& path, llvm::StringRef msgpack,
+                         std::string& record);
+
+// Describes the options that change the dumped json, for the result cache
+std::string getOutputConfig(const TranslationOptions& options);
+
+// Translates a single file into the output translateFiles writes for it,
+// without streaming statements. The translation is written in arena, then
+// copied into output, which keeps its memory.
+int translateFileToString(
+    const clang::tooling::CompilationDatabase& compilations,
+    const std::string& path, const TranslationOptions& options,
+    OutputArena& arena, std::string& output);
+
+// Translates all the files using options.jobs threads. Results are written to
+// `out` in input order, as soon as a result and all the ones before it are
+// finished. With a single thread, files that are not cached or wrapped, and
+// streamed statements, are written right away. Returns the worst status of
+// all the files.
+int translateFiles(const clang::tooling::CompilationDatabase& compilations,
+                   const std::vector<std::string>& paths,
+                   const TranslationOptions& options, std::FILE* out);
+
+// A source and the compact json it was translated into, with the same options
+struct PreviousTranslation {
+  std::string source;
+  std::string output;
+};
+
+// Translates sources given in memory, one after another. The FileManager (and
+// its cache of header lookups) and the action factory are kept between calls,
+// the FileManager for up to 1024 sources.
+class SourceTranslator {
+public:
+  SourceTranslator(const clang::tooling::CompilationDatabase& compilations,
+                   const TranslationOptions& options);
+  ~SourceTranslator();
+
+  // Translates source as if it was the file `name`, with extra flags appended
+  // to the ones of the compilation database. The result is valid until the
+  // next call.
+  int translate(const std::string& name, const std::string& source,
+                const std::vector<std::string>& flags);
+  // Like translate, but reusing and filling the result cache of the options.
+  // output is the compact json, ending with a newline. With previous, it is
+  // translateIncremental instead, without the cache.
+  int translateToString(const std::string& name, const std::string& source,
+                        const std::vector<std::string>& flags,
+                        std::string& output,
+                        const PreviousTranslation* previous = nullptr);
+  // Like translate, copying the statements of previous that did not change
+  // (see IncrementalReuse) instead of translating them again. The result
+  // cache is not used.
+  int translateIncremental(const std::string& name, const std::string& source,
+                           const std::vector<std::string>& flags,
+                           const PreviousTranslation& previous);
+  // Compact json of the last translation, without a trailing newline
+  llvm::StringRef getOutput() const {
+    return llvm::StringRef(buffer.GetString(), buffer.GetSize());
+  }
+
+private:
+  int run(const std::string& name, const std::string& source,
+          const std::vector<std::string>& flags,
+          clang::tooling::ToolAction& action);
+  // A single parse of source at path, with flags and pch if it is not empty
+  int invoke(const std::string& path, const std::string& source,
+             const std::vector<std::string>& flags, const std::string& pch,
+             clang::tooling::ToolAction& action);
+
+  const clang::tooling::CompilationDatabase& compilations;
+  const TranslationOptions& options;
+  std::unique_ptr<clang::FileManager> files;
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer;
+  JsonHandlerAdapter<rapidjson::Writer<rapidjson::StringBuffer>> handler;
+  SuperastCPPOptions visitorOptions;
+  std::unique_ptr<SuperastCPPActionFactory> factory;
+  unsigned numTranslations;
+};
+
+#endif // CPPTRANSLATE_TRANSLATOR_H
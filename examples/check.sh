@@ -0,0 +1,37 @@
+#!/bin/sh
+# Checks a build of cpptranslate against the examples. The translation of
+# each input.cpp, with -format=pretty, must be its output.json, and
+# -check-only must find the messages of output.json, without ids. The
+# messages are compared with jq, in any order.
+#
+#	examples/check.sh path/to/cpptranslate
+
+tool=${1:?usage: check.sh CPPTRANSLATE}
+examples=$(dirname "$0")
+failed=0
+
+for example in "$examples"/*/; do
+  example=${example%/}
+  name=$(basename "$example")
+
+  if ! difference=$("$tool" -format=pretty "$example/input.cpp" -- \
+      2>/dev/null | diff -u "$example/output.json" -); then
+    echo "FAIL $name: output differs from output.json"
+    printf '%s\n' "$difference"
+    failed=1
+  fi
+
+  expected=$(jq -S -c '[.. | objects | select(has("description")) | del(.id)]
+      | sort' "$example/output.json")
+  found=$("$tool" -check-only "$example/input.cpp" -- 2>/dev/null |
+      jq -S -c 'sort')
+  if [ "$found" != "$expected" ]; then
+    echo "FAIL $name: -check-only messages differ from output.json"
+    echo "expected: $expected"
+    echo "found:    $found"
+    failed=1
+  fi
+done
+
+[ "$failed" -eq 0 ] && echo "All examples passed"
+exit "$failed"
@@ -0,0 +1,22 @@
+#include <vector>
+using namespace std;
+
+struct point {
+  int x;
+};
+
+bool operator<(const point& a, const point& b) {
+  return true;
+}
+
+void f(int x) {
+}
+
+int main() {
+  vector<int> v(1, (1, 2));
+  point p = {(1, 2)};
+  p < (p, p);
+  void (*g)(int) = f;
+  g((1, 2));
+  int a{(1, 2)};
+}